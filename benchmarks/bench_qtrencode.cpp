@@ -0,0 +1,253 @@
+﻿#include <QtTest>
+#include "qtrencode.h"
+#include "qtrencodekeycache.h"
+#include "qtrencodeparallel.h"
+#include "qtrencodetree.h"
+
+class BenchQtRencode : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void initTestCase();
+
+  void bench_dumps_data();
+  void bench_dumps();
+  void bench_dumps_parallel_data();
+  void bench_dumps_parallel();
+  void bench_dumps_json_data();
+  void bench_dumps_json();
+  void bench_from_json_data();
+  void bench_from_json();
+  void bench_loads_json_data();
+  void bench_loads_json();
+  void bench_loads_key_cache_data();
+  void bench_loads_key_cache();
+  void bench_loads_raw_data();
+  void bench_loads_raw();
+  void bench_loads_parallel_data();
+  void bench_loads_parallel();
+  void bench_tree_data();
+  void bench_tree();
+  void bench_validate_data();
+  void bench_validate();
+  void bench_batch_data();
+  void bench_batch();
+
+ private:
+  struct Corpus {
+    const char *name;
+    QVariant value;
+    QByteArray json;
+    QByteArray encoded;
+  };
+
+  void add_corpus(const char *name, const QVariant &value);
+  void add_rows();
+
+  QList<Corpus> m_corpora;
+};
+
+// 每个用例额外计时的最短时间，用来计算ns/op和MB/s
+static const qint64 MIN_TIME_MS = 200;
+
+/**
+ * @brief measure
+ * @param bytes 每次操作处理的字节数
+ * @param func
+ * 循环运行func至少MIN_TIME_MS毫秒，输出ns/op和MB/s
+ */
+template <typename Func>
+static void measure(qint64 bytes, Func func) {
+  QElapsedTimer timer;
+  qint64 ops = 0;
+  timer.start();
+  do {
+    func();
+    ops++;
+  } while (timer.elapsed() < MIN_TIME_MS);
+  double ns = double(timer.nsecsElapsed());
+  qInfo("%-16s %12.0f ns/op %10.1f MB/s", QTest::currentDataTag(), ns / ops,
+        bytes * ops / (ns / 1e9) / (1024 * 1024));
+}
+
+void BenchQtRencode::initTestCase() {
+  QVariantList configure = QJsonDocument::fromJson(
+                               "[\"configure-window\",1,242,265,667.2,471,"
+                               "{\"name\":\"irony\"},0,{\"1\":2},[false,true],"
+                               "1,[1367,281],[]]")
+                               .toVariant()
+                               .toList();
+
+  QVariantList ints;
+  for (int i = 0; i < 100000; i++) ints << (i * 7919) % 100003 - 50000;
+
+  QVariantList floats;
+  for (int i = 0; i < 100000; i++) floats << i * 0.25 - 12500.0;
+
+  QVariantList strings;
+  for (int i = 0; i < 64; i++)
+    strings << QString(64 * 1024, QChar('a' + i % 26));
+
+  QVariant deep = QVariantList();
+  for (int i = 0; i < 500; i++) deep = QVariantList() << i << deep;
+
+  QVariantMap wide;
+  for (int i = 0; i < 10000; i++)
+    wide.insert(QString("key%1").arg(i), QString("value%1").arg(i));
+
+  add_corpus("configure_window", configure);
+  add_corpus("int_array", ints);
+  add_corpus("float_array", floats);
+  add_corpus("long_strings", strings);
+  add_corpus("deep_nesting", deep);
+  add_corpus("wide_dict", wide);
+}
+
+void BenchQtRencode::add_corpus(const char *name, const QVariant &value) {
+  Corpus corpus;
+  corpus.name = name;
+  corpus.value = value;
+  corpus.json =
+      QJsonDocument::fromVariant(value).toJson(QJsonDocument::Compact);
+  corpus.encoded = QtRencode::dumps(value);
+  m_corpora.append(corpus);
+}
+
+void BenchQtRencode::add_rows() {
+  QTest::addColumn<int>("index");
+  for (int i = 0; i < m_corpora.size(); i++)
+    QTest::newRow(m_corpora.at(i).name) << i;
+}
+
+void BenchQtRencode::bench_dumps_data() { add_rows(); }
+
+void BenchQtRencode::bench_dumps() {
+  QFETCH(int, index);
+  const Corpus &corpus = m_corpora.at(index);
+  QBENCHMARK { QtRencode::dumps(corpus.value); }
+  measure(corpus.encoded.size(), [&] { QtRencode::dumps(corpus.value); });
+}
+
+void BenchQtRencode::bench_dumps_parallel_data() { add_rows(); }
+
+void BenchQtRencode::bench_dumps_parallel() {
+  QFETCH(int, index);
+  const Corpus &corpus = m_corpora.at(index);
+  QByteArray out;
+  QBENCHMARK { QtRencodeParallel::dumps(corpus.value, &out); }
+  measure(corpus.encoded.size(),
+          [&] { QtRencodeParallel::dumps(corpus.value, &out); });
+}
+
+void BenchQtRencode::bench_dumps_json_data() { add_rows(); }
+
+void BenchQtRencode::bench_dumps_json() {
+  QFETCH(int, index);
+  const Corpus &corpus = m_corpora.at(index);
+  QBENCHMARK { QtRencode::dumps(corpus.json); }
+  measure(corpus.json.size(), [&] { QtRencode::dumps(corpus.json); });
+}
+
+void BenchQtRencode::bench_from_json_data() { add_rows(); }
+
+void BenchQtRencode::bench_from_json() {
+  QFETCH(int, index);
+  const Corpus &corpus = m_corpora.at(index);
+  QBENCHMARK { QtRencode::fromJson(corpus.json); }
+  measure(corpus.json.size(), [&] { QtRencode::fromJson(corpus.json); });
+}
+
+void BenchQtRencode::bench_loads_json_data() { add_rows(); }
+
+void BenchQtRencode::bench_loads_json() {
+  QFETCH(int, index);
+  const Corpus &corpus = m_corpora.at(index);
+  QBENCHMARK { QtRencode::loads(corpus.encoded, true); }
+  measure(corpus.encoded.size(),
+          [&] { QtRencode::loads(corpus.encoded, true); });
+}
+
+void BenchQtRencode::bench_loads_key_cache_data() { add_rows(); }
+
+void BenchQtRencode::bench_loads_key_cache() {
+  QFETCH(int, index);
+  const Corpus &corpus = m_corpora.at(index);
+  QtRencodeKeyCache cache;
+  QtRencode::Options options;
+  options.keyCache = &cache;
+  QVariant value;
+  QBENCHMARK { QtRencode::loads(corpus.encoded, &value, options); }
+  measure(corpus.encoded.size(),
+          [&] { QtRencode::loads(corpus.encoded, &value, options); });
+}
+
+void BenchQtRencode::bench_loads_raw_data() { add_rows(); }
+
+void BenchQtRencode::bench_loads_raw() {
+  QFETCH(int, index);
+  const Corpus &corpus = m_corpora.at(index);
+  QBENCHMARK { QtRencode::loads(corpus.encoded, false); }
+  measure(corpus.encoded.size(),
+          [&] { QtRencode::loads(corpus.encoded, false); });
+}
+
+void BenchQtRencode::bench_loads_parallel_data() { add_rows(); }
+
+void BenchQtRencode::bench_loads_parallel() {
+  QFETCH(int, index);
+  const Corpus &corpus = m_corpora.at(index);
+  QtRencode::Options options;
+  options.useJson = false;
+  QVariant value;
+  QBENCHMARK { QtRencodeParallel::loads(corpus.encoded, &value, options); }
+  measure(corpus.encoded.size(),
+          [&] { QtRencodeParallel::loads(corpus.encoded, &value, options); });
+}
+
+void BenchQtRencode::bench_tree_data() { add_rows(); }
+
+void BenchQtRencode::bench_tree() {
+  QFETCH(int, index);
+  const Corpus &corpus = m_corpora.at(index);
+  // 复用同一棵树，稳定后不再分配内存
+  QtRencodeTree tree;
+  QBENCHMARK { tree.parse(corpus.encoded); }
+  measure(corpus.encoded.size(), [&] { tree.parse(corpus.encoded); });
+}
+
+void BenchQtRencode::bench_validate_data() { add_rows(); }
+
+void BenchQtRencode::bench_validate() {
+  QFETCH(int, index);
+  const Corpus &corpus = m_corpora.at(index);
+  QBENCHMARK { QtRencode::validate(corpus.encoded); }
+  measure(corpus.encoded.size(), [&] { QtRencode::validate(corpus.encoded); });
+}
+
+void BenchQtRencode::bench_batch_data() {
+  QTest::addColumn<bool>("batch");
+  QTest::newRow("per_call") << false;
+  QTest::newRow("batch") << true;
+}
+
+void BenchQtRencode::bench_batch() {
+  QFETCH(bool, batch);
+  // 许多小帧：逐个dumps与一次encodeBatch
+  QVector<QVariant> frames(1000, m_corpora.at(0).value);
+  QByteArray out;
+  QVector<int> offsets;
+  auto run = [&] {
+    if (batch) {
+      QtRencode::encodeBatch(frames.constData(), frames.size(), &out,
+                             &offsets);
+    } else {
+      for (int i = 0; i < frames.size(); i++) QtRencode::dumps(frames.at(i));
+    }
+  };
+  QBENCHMARK { run(); }
+  measure(m_corpora.at(0).encoded.size() * frames.size(), run);
+}
+
+QTEST_APPLESS_MAIN(BenchQtRencode)
+
+#include "bench_qtrencode.moc"
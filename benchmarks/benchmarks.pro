@@ -0,0 +1,34 @@
+QT += testlib
+QT -= gui
+
+CONFIG += qt console warn_on depend_includepath release
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+DEFINES += QTRENCODE_NO_TRACE
+
+TEMPLATE = app
+
+INCLUDEPATH += $$PWD/../src
+
+SOURCES +=  bench_qtrencode.cpp \
+    ../src/qtrencode.cpp \
+    ../src/qtrencodebyteorder.cpp \
+    ../src/qtrencodedocument.cpp \
+    ../src/qtrencodekeycache.cpp \
+    ../src/qtrencodelog.cpp \
+    ../src/qtrencodemappedfile.cpp \
+    ../src/qtrencodeparallel.cpp \
+    ../src/qtrencodestream.cpp \
+    ../src/qtrencodetree.cpp
+
+HEADERS += \
+    ../src/qtrencode.h \
+    ../src/qtrencodebyteorder.h \
+    ../src/qtrencodedocument.h \
+    ../src/qtrencodekeycache.h \
+    ../src/qtrencodelog.h \
+    ../src/qtrencodemappedfile.h \
+    ../src/qtrencodeparallel.h \
+    ../src/qtrencodestream.h \
+    ../src/qtrencodetree.h
@@ -1,5 +1,81 @@
 ﻿#include "qtrencode.h"
 
+#include "qtrencodebyteorder.h"
+#include "qtrencodekeycache.h"
+
+#include <QLocale>
+#include <QVarLengthArray>
+#include <QtNumeric>
+
+#include <atomic>
+#include <limits>
+#include <type_traits>
+
+// 跟踪回调，未设置时每个跟踪点只多一次原子读和一次分支；
+// 定义QTRENCODE_NO_TRACE时跟踪点在编译期被完全去掉
+static std::atomic<QtRencode::TraceHandler> trace_handler(NULL);
+
+// 批量转换字节序时每块的元素个数
+static const int BYTE_ORDER_BLOCK = 256;
+#ifdef QTRENCODE_NO_TRACE
+#define QTRENCODE_TRACE(typecode, offset, length) \
+  do {                                            \
+    if (false) {                                  \
+      (void)(typecode);                           \
+      (void)(offset);                             \
+      (void)(length);                             \
+    }                                             \
+  } while (0)
+#else
+#define QTRENCODE_TRACE(typecode, offset, length)                       \
+  do {                                                                  \
+    QtRencode::TraceHandler handler =                                   \
+        trace_handler.load(std::memory_order_relaxed);                  \
+    if (Q_UNLIKELY(handler != NULL))                                    \
+      handler(__FUNCTION__, (quint8)(typecode), (quint32)(offset),      \
+              (quint32)(length));                                       \
+  } while (0)
+#endif
+
+static inline const char *skip_space(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+    p++;
+  return p;
+}
+
+static int hex4(const char *p, const char *end) {
+  if (end - p < 4) return -1;
+  int u = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = p[i] | 0x20;
+    if ('0' <= p[i] && p[i] <= '9')
+      u = (u << 4) | (p[i] - '0');
+    else if ('a' <= c && c <= 'f')
+      u = (u << 4) | (c - 'a' + 10);
+    else
+      return -1;
+  }
+  return u;
+}
+
+static void append_utf8(QByteArray *out, uint u) {
+  if (u < 0x80) {
+    out->append(char(u));
+  } else if (u < 0x800) {
+    out->append(char(0xC0 | (u >> 6)));
+    out->append(char(0x80 | (u & 0x3F)));
+  } else if (u < 0x10000) {
+    out->append(char(0xE0 | (u >> 12)));
+    out->append(char(0x80 | ((u >> 6) & 0x3F)));
+    out->append(char(0x80 | (u & 0x3F)));
+  } else {
+    out->append(char(0xF0 | (u >> 18)));
+    out->append(char(0x80 | ((u >> 12) & 0x3F)));
+    out->append(char(0x80 | ((u >> 6) & 0x3F)));
+    out->append(char(0x80 | (u & 0x3F)));
+  }
+}
+
 /**
  * @brief QtRencode::dumps
  * @param data
@@ -8,43 +84,38 @@
  * 对原始json数据编码
  */
 QByteArray QtRencode::dumps(const QByteArray &data, int bits) {
-  FLOAT_BITS = bits;
-  QJsonParseError error;
-  QJsonDocument json = QJsonDocument::fromJson(data, &error);
-  if (error.error != QJsonParseError::NoError) {
-    qCritical() << error.errorString();
-    return QByteArray();
-  }
-  return dumps(json, bits);
+  Options options;
+  options.floatBits = bits;
+  return dumps(data, options);
 }
 
 /**
  * @brief QtRencode::dumps
  * @param data
  * @param bits
+ * @param capacity
  * @return QByteArray
  * 对josn数据编码
  */
-QByteArray QtRencode::dumps(const QJsonDocument &data, int bits) {
-  FLOAT_BITS = bits;
-  return dumps(data.toVariant());
+QByteArray QtRencode::dumps(const QJsonDocument &data, int bits,
+                            int capacity) {
+  Options options;
+  options.floatBits = bits;
+  return dumps(data, options, capacity);
 }
 
 /**
  * @brief QtRencode::dumps
  * @param data
  * @param bits
+ * @param capacity
  * @return QByteArray
- * 对QVariant数据编码
+ * 对QVariant数据编码，capacity为输出缓冲区的初始容量提示
  */
-QByteArray QtRencode::dumps(const QVariant &data, int bits) {
-  FLOAT_BITS = bits;
-  char *buf = NULL;
-  unsigned int pos = 0;
-  encode(&buf, &pos, data);
-  QByteArray result = QByteArray(buf, pos);
-  free(buf);
-  return result;
+QByteArray QtRencode::dumps(const QVariant &data, int bits, int capacity) {
+  Options options;
+  options.floatBits = bits;
+  return dumps(data, options, capacity);
 }
 
 /**
@@ -54,587 +125,2266 @@ QByteArray QtRencode::dumps(const QVariant &data, int bits) {
  * 编码后的数据解码为json
  */
 QVariant QtRencode::loads(const QByteArray &data, bool json) {
-  USE_JSON = json;
+  Options options;
+  options.useJson = json;
+  return loads(data, options);
+}
+
+/**
+ * @brief QtRencode::dumps
+ * @param data
+ * @param options
+ * @return QByteArray
+ * 按指定选项对原始json数据编码。经QJsonDocument::toVariant()转换，整数按
+ * 浮点数编码、对象的键按排序输出，与以前的输出保持一致；需要单遍转换、
+ * 保留整数和键的原有顺序时用fromJson
+ */
+QByteArray QtRencode::dumps(const QByteArray &data, const Options &options) {
+  QJsonParseError error;
+  QJsonDocument json = QJsonDocument::fromJson(data, &error);
+  if (error.error != QJsonParseError::NoError) return QByteArray();
+  return dumps(json, options, data.size());
+}
+
+/**
+ * @brief QtRencode::dumps
+ * @param data
+ * @param options
+ * @param capacity
+ * @return QByteArray
+ * 按指定选项对josn数据编码
+ */
+QByteArray QtRencode::dumps(const QJsonDocument &data, const Options &options,
+                            int capacity) {
+  return dumps(data.toVariant(), options, capacity);
+}
+
+/**
+ * @brief QtRencode::dumps
+ * @param data
+ * @param options
+ * @param capacity
+ * @return QByteArray
+ * 按指定选项对QVariant数据编码，可在多个线程中同时调用
+ */
+QByteArray QtRencode::dumps(const QVariant &data, const Options &options,
+                            int capacity) {
+  QtRencodeBuffer buf(capacity);
+  buf.setMaxSize(options.maxOutputSize);
+  encode(&buf, data, options);
+  return buf.take();
+}
+
+/**
+ * @brief QtRencode::loads
+ * @param data
+ * @param options
+ * @return QVariant
+ * 按指定选项解码，可在多个线程中同时调用
+ */
+QVariant QtRencode::loads(const QByteArray &data, const Options &options) {
   quint32 pos = 0;
-  return decode(data, &pos);
+  return decode(data, &pos, options);
+}
+
+/**
+ * @brief QtRencode::dumps
+ * @param data
+ * @param out 编码结果，失败时为空
+ * @param options
+ * @return Result
+ * 编码并报告错误，不输出日志
+ */
+QtRencode::Result QtRencode::dumps(const QVariant &data, QByteArray *out,
+                                   const Options &options) {
+  QtRencodeBuffer buf;
+  buf.setMaxSize(options.maxOutputSize);
+  encode(&buf, data, options);
+  Result result;
+  if (Q_UNLIKELY(buf.failure() != NoError)) {
+    result.error = Error(buf.failure());
+    result.offset = buf.failureOffset();
+    out->clear();
+    return result;
+  }
+  out[0] = buf.take();
+  return result;
+}
+
+/**
+ * @brief QtRencode::loads
+ * @param data
+ * @param value 解码结果，失败时为空
+ * @param options
+ * @param limits
+ * @return Result
+ * 按指定上限解码不可信数据并报告错误，不输出日志；
+ * 返回值区分了解码失败与成功解码出的None
+ */
+QtRencode::Result QtRencode::loads(const QByteArray &data, QVariant *value,
+                                   const Options &options,
+                                   const Limits &limits) {
+  unsigned int pos = 0;
+  DecodeContext ctx = {options, limits, 0, 0, NoError, 0, NULL};
+  value[0] = decode(data, &pos, &ctx);
+  Result result;
+  if (Q_UNLIKELY(ctx.error != NoError)) {
+    result.error = ctx.error;
+    result.offset = ctx.errorOffset;
+    if (ctx.errorOffset < (unsigned int)data.size())
+      result.typecode = data.at(ctx.errorOffset);
+    value[0] = QVariant();
+  }
+  return result;
 }
 
-void QtRencode::swap_byte_order_ushort(unsigned short *s) {
-  s[0] = (s[0] >> 8) | (s[0] << 8);
+/**
+ * @brief QtRencode::dump
+ * @param device
+ * @param data
+ * @param options
+ * @param chunkSize
+ * @return bool
+ * 编码并写入设备，内存占用不超过chunkSize，每写满一块调用一次write。
+ * 写入失败或编码出错时返回false，此时已写入设备的数据不完整
+ */
+bool QtRencode::dump(QIODevice *device, const QVariant &data,
+                     const Options &options, int chunkSize) {
+  QtRencodeBuffer buf(device, chunkSize);
+  encode(&buf, data, options);
+  return buf.flush() && buf.failure() == NoError;
 }
 
-short QtRencode::swap_byte_order_short(char *c) {
-  short s;
-  char *p = (char *)(&s);
-  p[0] = c[1];
-  p[1] = c[0];
-  return s;
+/**
+ * @brief QtRencode::dumps
+ * @param data
+ * @return QByteArray
+ * 数值数组的快速编码，逐元素直接写入而不装箱成QVariant。整数数组的输出与
+ * 同样内容的QVariantList相同；浮点数组按元素自身的位数编码，不受floatBits
+ * 影响：double数组与元素为double、floatBits为64时的QVariantList相同，
+ * float数组与元素为double、floatBits为32时的QVariantList相同
+ * （encode把QVariant(float)当作整数，不能用来对照）。
+ * 输出超过QtRencodeBuffer::MAX_SIZE时返回空
+ */
+QByteArray QtRencode::dumps(const QVector<qint32> &data) {
+  return encode_array(data.constData(), data.size());
 }
 
-void QtRencode::swap_byte_order_uint(int *i) {
-  i[0] = (i[0] >> 24) | ((i[0] << 8) & 0x00FF0000) |
-         ((i[0] >> 8) & 0x0000FF00) | (i[0] << 24);
+QByteArray QtRencode::dumps(const QVector<qint64> &data) {
+  return encode_array(data.constData(), data.size());
 }
 
-int QtRencode::swap_byte_order_int(char *c) {
-  int i;
-  char *p = (char *)(&i);
-  p[0] = c[3];
-  p[1] = c[2];
-  p[2] = c[1];
-  p[3] = c[0];
-  return i;
+QByteArray QtRencode::dumps(const QVector<float> &data) {
+  return encode_array(data.constData(), data.size());
 }
 
-void QtRencode::swap_byte_order_ulong_long(long long *l) {
-  l[0] =
-      (l[0] >> 56) | ((l[0] << 40) & 0x00FF000000000000) |
-      ((l[0] << 24) & 0x0000FF0000000000) | ((l[0] << 8) & 0x000000FF00000000) |
-      ((l[0] >> 8) & 0x00000000FF000000) | ((l[0] >> 24) & 0x0000000000FF0000) |
-      ((l[0] >> 40) & 0x000000000000FF00) | (l[0] << 56);
+QByteArray QtRencode::dumps(const QVector<double> &data) {
+  return encode_array(data.constData(), data.size());
 }
 
-long long QtRencode::swap_byte_order_long_long(char *c) {
-  long long l;
-  char *p = (char *)(&l);
-  p[0] = c[7];
-  p[1] = c[6];
-  p[2] = c[5];
-  p[3] = c[4];
-  p[4] = c[3];
-  p[5] = c[2];
-  p[6] = c[1];
-  p[7] = c[0];
-  return l;
+QByteArray QtRencode::dumps(const std::vector<qint32> &data) {
+  return encode_array(data.data(), int(data.size()));
 }
 
-float QtRencode::swap_byte_order_float(char *c) {
-  float f;
-  char *p = (char *)(&f);
-  p[0] = c[3];
-  p[1] = c[2];
-  p[2] = c[1];
-  p[3] = c[0];
-  return f;
+QByteArray QtRencode::dumps(const std::vector<qint64> &data) {
+  return encode_array(data.data(), int(data.size()));
 }
 
-double QtRencode::swap_byte_order_double(char *c) {
-  double d;
-  char *p = (char *)(&d);
-  p[0] = c[7];
-  p[1] = c[6];
-  p[2] = c[5];
-  p[3] = c[4];
-  p[4] = c[3];
-  p[5] = c[2];
-  p[6] = c[1];
-  p[7] = c[0];
-  return d;
-}
-
-void QtRencode::write_buffer_char(char **buf, unsigned int *pos, char c) {
-  buf[0] = (char *)(realloc(buf[0], pos[0] + 1));
-  Q_ASSERT_X(buf[0] != NULL, "write_buffer_char",
-             "Error in realloc, 1 byte needed");
-  memcpy(&buf[0][pos[0]], &c, 1);
-  pos[0] += 1;
+QByteArray QtRencode::dumps(const std::vector<float> &data) {
+  return encode_array(data.data(), int(data.size()));
 }
 
-void QtRencode::write_buffer(char **buf, unsigned int *pos, void *data,
-                             int size) {
-  buf[0] = (char *)(realloc(buf[0], pos[0] + size));
-  Q_ASSERT_X(
-      buf[0] != NULL, "write_buffer",
-      QString("Error in realloc, %1 bytes needed").arg(size).toUtf8().data());
-  memcpy(&buf[0][pos[0]], data, size);
-  pos[0] += size;
+QByteArray QtRencode::dumps(const std::vector<double> &data) {
+  return encode_array(data.data(), int(data.size()));
 }
 
-bool QtRencode::check_pos(const QByteArray &data, unsigned int pos) {
-  if (pos >= (unsigned int)data.size()) {
-    qCritical() << "Tried to access data[" << pos
-                << "] but data len is: " << data.size();
+/**
+ * @brief QtRencode::loads
+ * @param data
+ * @param out
+ * @return bool
+ * 把数值列表直接解码到数组。元素不是数值、整数超出范围或数据格式错误时
+ * 返回false；整数可以解码到浮点数组，浮点数不能解码到整数数组
+ */
+bool QtRencode::loads(const QByteArray &data, QVector<qint32> *out) {
+  return decode_array(data, out);
+}
+
+bool QtRencode::loads(const QByteArray &data, QVector<qint64> *out) {
+  return decode_array(data, out);
+}
+
+bool QtRencode::loads(const QByteArray &data, QVector<float> *out) {
+  return decode_array(data, out);
+}
+
+bool QtRencode::loads(const QByteArray &data, QVector<double> *out) {
+  return decode_array(data, out);
+}
+
+bool QtRencode::loads(const QByteArray &data, std::vector<qint32> *out) {
+  return decode_array(data, out);
+}
+
+bool QtRencode::loads(const QByteArray &data, std::vector<qint64> *out) {
+  return decode_array(data, out);
+}
+
+bool QtRencode::loads(const QByteArray &data, std::vector<float> *out) {
+  return decode_array(data, out);
+}
+
+bool QtRencode::loads(const QByteArray &data, std::vector<double> *out) {
+  return decode_array(data, out);
+}
+
+/**
+ * @brief QtRencode::encodedSize
+ * @param data
+ * @param options
+ * @return qint64
+ * 编码后的字节数。用只计数不写入的缓冲区运行同一套编码函数，
+ * 因此与dumps的结果总是一致，且不分配输出内存。编码出错时返回-1
+ */
+qint64 QtRencode::encodedSize(const QVariant &data, const Options &options) {
+  QtRencodeBuffer buf((char *)NULL, 0);
+  encode(&buf, data, options);
+  return buf.failure() == NoError ? buf.size() : -1;
+}
+
+/**
+ * @brief QtRencode::encodeInto
+ * @param out
+ * @param capacity
+ * @param data
+ * @param options
+ * @return qint64
+ * 直接编码到调用者提供的内存，不分配也不复制。返回编码所需的字节数，
+ * 大于capacity时表示空间不足，out中的内容无效；编码出错时返回-1
+ */
+qint64 QtRencode::encodeInto(char *out, size_t capacity, const QVariant &data,
+                             const Options &options) {
+  QtRencodeBuffer buf(out, int(qMin(capacity, size_t(INT_MAX))));
+  encode(&buf, data, options);
+  return buf.failure() == NoError ? buf.size() : -1;
+}
+
+/**
+ * @brief QtRencode::encodeSegments
+ * @param data
+ * @param segments
+ * @param options
+ * @param threshold
+ * @return qint64
+ * 分段编码，不短于threshold的字节串不复制，返回编码后的总字节数。
+ * 编码出错时返回-1，segments为空
+ */
+qint64 QtRencode::encodeSegments(const QVariant &data,
+                                 QtRencodeSegments *segments,
+                                 const Options &options, int threshold) {
+  segments->clear();
+  QtRencodeBuffer buf;
+  buf.setMaxSize(options.maxOutputSize);
+  buf.setSegments(segments, threshold);
+  encode(&buf, data, options);
+  qint64 size = buf.size();
+  buf.finishSegments();
+  if (buf.failure() != NoError) {
+    segments->clear();
+    return -1;
+  }
+  return size;
+}
+
+/**
+ * @brief QtRencode::setTraceHandler
+ * @param handler
+ * 设置跟踪回调，传入NULL关闭跟踪
+ */
+void QtRencode::setTraceHandler(TraceHandler handler) {
+  trace_handler.store(handler, std::memory_order_relaxed);
+}
+
+/**
+ * @brief QtRencode::debugTraceHandler
+ * 把跟踪信息输出到qDebug的回调
+ */
+void QtRencode::debugTraceHandler(const char *function, quint8 typecode,
+                                  quint32 offset, quint32 length) {
+  qDebug() << function << typecode << offset << length;
+}
+
+const int QtRencodeBuffer::MIN_CAPACITY;
+
+QtRencodeBuffer::QtRencodeBuffer(int capacity)
+    : m_data(NULL),
+      m_pos(0),
+      m_capacity(0),
+      m_device(NULL),
+      m_fixed(false),
+      m_written(0),
+      m_error(false),
+      m_failure(0),
+      m_failureOffset(-1),
+      m_maxSize(MAX_SIZE),
+      m_segments(NULL),
+      m_threshold(0),
+      m_mark(0) {
+  if (capacity > 0) reserve(capacity);
+}
+
+QtRencodeBuffer::QtRencodeBuffer(QIODevice *device, int capacity)
+    : m_data(NULL),
+      m_pos(0),
+      m_capacity(0),
+      m_device(device),
+      m_fixed(false),
+      m_written(0),
+      m_error(false),
+      m_failure(0),
+      m_failureOffset(-1),
+      m_maxSize(MAX_SIZE),
+      m_segments(NULL),
+      m_threshold(0),
+      m_mark(0) {
+  reserve(qMax(capacity, MIN_CAPACITY));
+}
+
+QtRencodeBuffer::QtRencodeBuffer(char *data, int capacity)
+    : m_data(data),
+      m_pos(0),
+      m_capacity(data != NULL ? capacity : 0),
+      m_device(NULL),
+      m_fixed(true),
+      m_written(0),
+      m_error(false),
+      m_failure(0),
+      m_failureOffset(-1),
+      m_maxSize(MAX_SIZE),
+      m_segments(NULL),
+      m_threshold(0),
+      m_mark(0) {}
+
+/**
+ * @brief QtRencodeBuffer::reserve
+ * @param capacity
+ * 预先分配至少capacity字节的空间
+ */
+void QtRencodeBuffer::reserve(int capacity) {
+  if (capacity <= m_capacity) return;
+  m_buffer.resize(capacity);
+  m_data = m_buffer.data();
+  m_capacity = capacity;
+}
+
+/**
+ * @brief QtRencodeBuffer::setMaxSize
+ * @param maxSize
+ * 设置编码结果的上限，在写入数据之前调用
+ */
+void QtRencodeBuffer::setMaxSize(qint64 maxSize) {
+  m_maxSize = qBound(qint64(0), maxSize, qint64(MAX_SIZE));
+  // 可用容量不超过上限，越过上限的写入都经过grow
+  if (m_capacity > m_maxSize) m_capacity = int(m_maxSize);
+}
+
+/**
+ * @brief QtRencodeBuffer::take
+ * @return QByteArray
+ * 取出已编码的数据，只截断长度不复制，之后缓冲区为空
+ */
+QByteArray QtRencodeBuffer::take() {
+  m_buffer.resize(m_pos);
+  QByteArray result;
+  result.swap(m_buffer);
+  m_data = NULL;
+  m_pos = 0;
+  m_capacity = 0;
+  return result;
+}
+
+/**
+ * @brief QtRencodeBuffer::flush
+ * @return bool
+ * 把缓冲的数据整块写入设备，没有设备时什么也不做
+ */
+bool QtRencodeBuffer::flush() {
+  if (m_device == NULL || m_pos == 0) return !m_error;
+  if (!m_error && m_device->write(m_data, m_pos) != m_pos) m_error = true;
+  m_written += m_pos;
+  m_pos = 0;
+  return !m_error;
+}
+
+/**
+ * @brief QtRencodeBuffer::truncate
+ * @param size
+ * @return bool
+ * 丢弃size之后编码的数据，只用于不分段的缓冲区。这些数据已有部分写入设备时
+ * 无法撤销，返回false
+ */
+bool QtRencodeBuffer::truncate(qint64 size) {
+  if (size < m_written || size > this->size()) return false;
+  m_pos = int(size - m_written);
+  return true;
+}
+
+/**
+ * @brief QtRencodeBuffer::fail
+ * @param error
+ * 记录编码错误，只保留第一个
+ */
+void QtRencodeBuffer::fail(int error) {
+  if (m_failure != 0) return;
+  m_failure = error;
+  m_failureOffset = size();
+}
+
+void QtRencodeBuffer::clearFailure() {
+  m_failure = 0;
+  m_failureOffset = -1;
+}
+
+/**
+ * @brief QtRencodeBuffer::setSegments
+ * @param segments
+ * @param threshold
+ * 开始分段输出，只用于未绑定设备的缓冲区
+ */
+void QtRencodeBuffer::setSegments(QtRencodeSegments *segments, int threshold) {
+  m_segments = segments;
+  m_threshold = qMax(threshold, 1);
+  m_mark = m_pos;
+}
+
+/**
+ * @brief QtRencodeBuffer::reference
+ * @param data
+ * 结束当前的头部段并引用data，被引用的字节计入size()
+ */
+void QtRencodeBuffer::reference(const QByteArray &data) {
+  m_segments->add_header(m_mark, m_pos - m_mark);
+  m_segments->add_blob(data);
+  m_mark = m_pos;
+  m_written += data.size();
+}
+
+/**
+ * @brief QtRencodeBuffer::finishSegments
+ * 结束分段输出，头部字节交给QtRencodeSegments
+ */
+void QtRencodeBuffer::finishSegments() {
+  m_segments->add_header(m_mark, m_pos - m_mark);
+  m_segments->m_headers = take();
+  m_segments = NULL;
+  m_mark = 0;
+}
+
+const char *QtRencodeSegments::data(int i) const {
+  const Piece &piece = m_pieces.at(i);
+  return piece.blob < 0 ? m_headers.constData() + piece.offset
+                        : m_blobs.at(piece.blob).constData();
+}
+
+qint64 QtRencodeSegments::totalSize() const {
+  qint64 total = 0;
+  for (const Piece &piece : m_pieces) total += piece.size;
+  return total;
+}
+
+/**
+ * @brief QtRencodeSegments::join
+ * @return QByteArray
+ * 把各段拼接成完整的编码数据
+ */
+QByteArray QtRencodeSegments::join() const {
+  QByteArray result;
+  result.reserve(int(totalSize()));
+  for (int i = 0; i < m_pieces.size(); i++)
+    result.append(data(i), m_pieces.at(i).size);
+  return result;
+}
+
+void QtRencodeSegments::clear() {
+  m_headers.clear();
+  m_pieces.clear();
+  m_blobs.clear();
+}
+
+void QtRencodeSegments::add_header(int offset, int size) {
+  if (size == 0) return;
+  // 与上一个头部段相邻时合并
+  if (!m_pieces.isEmpty()) {
+    Piece &last = m_pieces.last();
+    if (last.blob < 0 && last.offset + last.size == offset) {
+      last.size += size;
+      return;
+    }
+  }
+  Piece piece = {offset, size, -1};
+  m_pieces.append(piece);
+}
+
+void QtRencodeSegments::add_blob(const QByteArray &data) {
+  Piece piece = {-1, data.size(), m_blobs.size()};
+  m_pieces.append(piece);
+  m_blobs.append(data);
+}
+
+bool QtRencodeBuffer::grow(int size) {
+  if (m_device != NULL) {
+    flush();
+    return true;
+  }
+  // 容量按两倍增长，使每字节写入的均摊开销为常数；用qint64计算以免溢出
+  qint64 required = qint64(m_pos) + size;
+  if (required > m_maxSize) {
+    fail(QtRencode::OutputTooLarge);
     return false;
   }
+  qint64 capacity = qMax(qint64(m_capacity) * 2, qint64(MIN_CAPACITY));
+  while (capacity < required) capacity *= 2;
+  reserve(int(qMin(capacity, m_maxSize)));
   return true;
 }
 
-void QtRencode::encode_char(char **buf, unsigned int *pos, signed char x) {
-  qDebug() << "---encode_char---" << &buf << pos[0] << x;
-  if (0 <= x && x < INT_POS_FIXED_COUNT)
-    write_buffer_char(buf, pos, INT_POS_FIXED_START + x);
-  else if (-INT_NEG_FIXED_COUNT <= x && x < 0)
-    write_buffer_char(buf, pos, INT_NEG_FIXED_START - 1 - x);
-  else if (-128 <= x && x <= 127) {
-    write_buffer_char(buf, pos, CHR_INT1);
-    write_buffer_char(buf, pos, x);
+void QtRencodeBuffer::write_slow(const void *data, int size) {
+  if (m_fixed) {
+    // 外部内存写满后只计数，用于得到所需的大小
+    m_error = true;
+    m_written += size;
+    return;
+  }
+  if (m_device != NULL && size >= m_capacity) {
+    // 比缓冲区还大的数据（长字符串）直接写入设备
+    flush();
+    if (!m_error && m_device->write((const char *)data, size) != size)
+      m_error = true;
+    m_written += size;
+    return;
   }
+  if (!grow(size)) {
+    // 超过最大长度时丢弃数据，只计数
+    m_error = true;
+    m_written += size;
+    return;
+  }
+  memcpy(m_data + m_pos, data, size);
+  m_pos += size;
 }
 
-void QtRencode::encode_short(char **buf, unsigned int *pos, short x) {
-  qDebug() << "---encode_short---" << &buf << pos[0] << x;
-  write_buffer_char(buf, pos, CHR_INT2);
-  if (!BIG_ENDIAN) {
-    if (x > 0)
-      swap_byte_order_ushort((unsigned short *)(&x));
-    else
-      x = swap_byte_order_short((char *)(&x));
+/**
+ * @brief QtRencode::encodeBatch
+ * @param values
+ * @param count
+ * @param out 所有值依次拼接的编码结果
+ * @param offsets 第i个值的起始位置，末尾另有一项为总长度，共count + 1项
+ * @param options
+ * @param capacity 输出缓冲区的初始容量提示
+ * @return Result
+ * 批量编码许多小值，共用一个输出缓冲区，避免每个值各自分配和复制一次
+ */
+QtRencode::Result QtRencode::encodeBatch(const QVariant *values, int count,
+                                         QByteArray *out,
+                                         QVector<int> *offsets,
+                                         const Options &options,
+                                         int capacity) {
+  return encode_batch(values, count, out, offsets, options, capacity);
+}
+
+QtRencode::Result QtRencode::encodeBatch(const QVariantList &values,
+                                         QByteArray *out,
+                                         QVector<int> *offsets,
+                                         const Options &options,
+                                         int capacity) {
+  return encode_batch(values.constBegin(), values.size(), out, offsets,
+                      options, capacity);
+}
+
+template <typename Iterator>
+QtRencode::Result QtRencode::encode_batch(Iterator values, int count,
+                                          QByteArray *out,
+                                          QVector<int> *offsets,
+                                          const Options &options,
+                                          int capacity) {
+  QtRencodeBuffer buf(capacity);
+  buf.setMaxSize(options.maxOutputSize);
+  offsets->resize(count + 1);
+  int *offset = offsets->data();
+  for (int i = 0; i < count; i++, ++values) {
+    offset[i] = int(buf.size());
+    encode(&buf, *values, options);
   }
-  write_buffer(buf, pos, &x, sizeof(x));
+  offset[count] = int(buf.size());
+  Result result;
+  if (Q_UNLIKELY(buf.failure() != NoError)) {
+    result.error = Error(buf.failure());
+    result.offset = buf.failureOffset();
+    out->clear();
+    offsets->clear();
+    return result;
+  }
+  out[0] = buf.take();
+  return result;
 }
 
-void QtRencode::encode_int(char **buf, unsigned int *pos, int x) {
-  qDebug() << "---encode_int---" << &buf << pos[0] << x;
-  write_buffer_char(buf, pos, CHR_INT4);
-  if (!BIG_ENDIAN) {
-    if (x > 0)
-      swap_byte_order_uint(&x);
-    else
-      x = swap_byte_order_int((char *)(&x));
+/**
+ * @brief QtRencode::decodeBatch
+ * @param data 依次拼接的多个值
+ * @param values 解码出的值追加到其后
+ * @param offsets 不为NULL时同encodeBatch
+ * @param options
+ * @param limits 分别作用于每个值
+ * @return Result
+ * 批量解码，各值共用同一个解码状态和编码查找结果；出错时values中保留
+ * 出错之前解码成功的值
+ */
+QtRencode::Result QtRencode::decodeBatch(const QByteArray &data,
+                                         QVariantList *values,
+                                         QVector<int> *offsets,
+                                         const Options &options,
+                                         const Limits &limits) {
+  DecodeContext ctx = {options, limits, 0, 0, NoError, 0, NULL};
+  unsigned int pos = 0;
+  if (offsets != NULL) offsets->clear();
+  while (pos < (unsigned int)data.size()) {
+    if (offsets != NULL) offsets->append(pos);
+    ctx.nodes = 0;
+    QVariant value = decode(data, &pos, &ctx);
+    if (Q_UNLIKELY(ctx.error != NoError)) {
+      Result result;
+      result.error = ctx.error;
+      result.offset = ctx.errorOffset;
+      if (ctx.errorOffset < (unsigned int)data.size())
+        result.typecode = data.at(ctx.errorOffset);
+      if (offsets != NULL) offsets->removeLast();
+      return result;
+    }
+    values->append(value);
   }
-  write_buffer(buf, pos, &x, sizeof(x));
+  if (offsets != NULL) offsets->append(pos);
+  return Result();
 }
 
-void QtRencode::encode_long_long(char **buf, unsigned int *pos, long long x) {
-  qDebug() << "---encode_long_long---" << &buf << pos[0] << x;
-  write_buffer_char(buf, pos, CHR_INT8);
-  if (!BIG_ENDIAN) {
-    if (x > 0)
-      swap_byte_order_ulong_long(&x);
-    else
-      x = swap_byte_order_long_long((char *)(&x));
+bool QtRencode::check_pos(const QByteArray &data, unsigned int pos) {
+  return pos < (unsigned int)data.size();
+}
+
+/**
+ * @brief QtRencode::big_number_length
+ * @param data
+ * @param pos CHR_INT所在位置
+ * @return int
+ * 大整数的数字个数（不含CHR_INT和CHR_TERM），数据不完整或过长时返回-1
+ */
+int QtRencode::big_number_length(const QByteArray &data, unsigned int pos) {
+  int x = 18;
+  if (!check_pos(data, pos + 1 + x)) return -1;
+  while (data.at(pos + 1 + x) != CHR_TERM) {
+    x += 1;
+    if (x >= MAX_INT_LENGTH) return -1;
+    if (!check_pos(data, pos + 1 + x)) return -1;
   }
-  write_buffer(buf, pos, &x, sizeof(x));
+  return x;
 }
 
-void QtRencode::encode_big_number(char **buf, unsigned int *pos,
-                                  QByteArray &x) {
-  qDebug() << "---encode_big_number---" << &buf << pos[0] << x;
-  write_buffer_char(buf, pos, CHR_INT);
-  char *d = x.data();
-  write_buffer(buf, pos, d, x.size());
-  write_buffer_char(buf, pos, CHR_TERM);
+/**
+ * @brief QtRencode::read_str_header
+ * @param data
+ * @param pos 长字符串"<长度>:"的起始位置
+ * @param size 字符串长度
+ * @param digits 长度的数字个数
+ * @return bool
+ * 解析长字符串的长度前缀，数据不完整或格式错误时返回false
+ */
+bool QtRencode::read_str_header(const QByteArray &data, unsigned int pos,
+                                int *size, int *digits) {
+  int x = 0;
+  qint64 n = 0;
+  while (true) {
+    if (!check_pos(data, pos + x)) return false;
+    char c = data.at(pos + x);
+    if (c == ':') break;
+    if (c < '0' || c > '9' || x >= 10) return false;
+    n = n * 10 + (c - '0');
+    x += 1;
+  }
+  if (x == 0 || n > INT_MAX) return false;
+  size[0] = (int)n;
+  digits[0] = x;
+  return true;
+}
+
+/**
+ * @brief QtRencode::token_length
+ * @param data
+ * @param size
+ * @param pos
+ * @return qint64
+ * data[pos]处单个记号的字节数，列表和字典只计类型码本身。
+ * 数据不完整时返回0，格式错误时返回-1
+ */
+qint64 QtRencode::token_length(const char *data, qint64 size, qint64 pos) {
+  if (pos >= size) return 0;
+  const TypeInfo &info = TYPE_TABLE[(quint8)data[pos]];
+  switch (info.kind) {
+    case KIND_INVALID:
+      return -1;
+    case KIND_BIG_NUMBER: {
+      qint64 x = 18;
+      while (true) {
+        if (pos + 1 + x >= size) return 0;
+        if ((quint8)data[pos + 1 + x] == CHR_TERM) return x + 2;
+        x += 1;
+        if (x >= MAX_INT_LENGTH) return -1;
+      }
+    }
+    case KIND_STR: {
+      qint64 x = 0;
+      qint64 n = 0;
+      while (true) {
+        if (pos + x >= size) return 0;
+        char c = data[pos + x];
+        if (c == ':') break;
+        if (c < '0' || c > '9' || x >= 10) return -1;
+        n = n * 10 + (c - '0');
+        x += 1;
+      }
+      if (n > INT_MAX) return -1;
+      return pos + x + 1 + n <= size ? x + 1 + n : 0;
+    }
+    default:
+      return pos + 1 + info.size <= size ? 1 + info.size : 0;
+  }
 }
 
-void QtRencode::encode_float32(char **buf, unsigned int *pos, float x) {
-  qDebug() << "---encode_float32---" << &buf << pos[0] << x;
-  write_buffer_char(buf, pos, CHR_FLOAT32);
-  if (!BIG_ENDIAN) x = swap_byte_order_float((char *)(&x));
-  write_buffer(buf, pos, &x, sizeof(x));
+/**
+ * @brief QtRencode::skip_value
+ * @param data
+ * @param size
+ * @param pos
+ * @param limits 为NULL时不检查上限
+ * @param result 出错的原因和位置
+ * @return qint64
+ * 只按类型码跳过data[pos]处的一个完整值（含嵌套的列表和字典），不解码、
+ * 不递归也不分配堆内存（嵌套很深时除外），返回该值之后的位置；
+ * 数据不完整、格式错误或超出上限时返回-1
+ */
+qint64 QtRencode::skip_value(const char *data, qint64 size, qint64 pos,
+                             const Limits *limits, Result *result) {
+  struct Level {
+    // 定长容器还剩的元素个数，以CHR_TERM结束的容器为-1
+    int remaining;
+    // 以CHR_TERM结束的容器已有的元素个数，字典的键和值分别计数
+    int count;
+    bool dict;
+    // 容器的起始位置，元素过多时作为出错位置，与解码时一致
+    qint64 start;
+  };
+  QVarLengthArray<Level, 32> stack;
+  qint64 nodes = 0;
+  Error error = NoError;
+  do {
+    if (pos >= size) {
+      error = TruncatedData;
+      break;
+    }
+    quint8 c = data[pos];
+    if (c == CHR_TERM) {
+      if (stack.isEmpty() || stack.last().remaining != -1) {
+        error = InvalidTypecode;
+        break;
+      }
+      stack.removeLast();
+      pos += 1;
+    } else {
+      // 与解码时一样，先检查容器的元素个数，再检查元素本身
+      if (limits != NULL && !stack.isEmpty() && stack.last().remaining < 0) {
+        Level &parent = stack.last();
+        qint64 max = qint64(limits->maxContainerSize) * (parent.dict ? 2 : 1);
+        if (++parent.count > max) {
+          error = ContainerLimitExceeded;
+          pos = parent.start;
+          break;
+        }
+      }
+      qint64 length = token_length(data, size, pos);
+      const TypeInfo &info = TYPE_TABLE[c];
+      if (length <= 0) {
+        if (length == 0)
+          error = TruncatedData;
+        else if (info.kind == KIND_INVALID)
+          error = InvalidTypecode;
+        else
+          error = MalformedData;
+        break;
+      }
+      if (limits != NULL) {
+        qint64 string = info.kind == KIND_FIXED_STR ? info.size : 0;
+        if (info.kind == KIND_STR) {
+          qint64 colon = pos;
+          while (data[colon] != ':') colon++;
+          string = length - (colon - pos + 1);
+        }
+        int fixed = info.kind == KIND_FIXED_LIST || info.kind == KIND_FIXED_DICT
+                        ? info.embedded
+                        : 0;
+        bool container = info.kind == KIND_LIST || info.kind == KIND_DICT ||
+                         info.kind == KIND_FIXED_LIST ||
+                         info.kind == KIND_FIXED_DICT;
+        if (++nodes > limits->maxNodes)
+          error = NodeLimitExceeded;
+        else if (string > limits->maxStringLength)
+          error = StringLimitExceeded;
+        else if (fixed > limits->maxContainerSize)
+          error = ContainerLimitExceeded;
+        else if (container && stack.size() >= limits->maxDepth)
+          error = DepthLimitExceeded;
+        if (error != NoError) break;
+      }
+      pos += length;
+      if (!stack.isEmpty() && stack.last().remaining > 0)
+        stack.last().remaining--;
+      if (info.kind == KIND_LIST || info.kind == KIND_DICT) {
+        Level level = {-1, 0, info.kind == KIND_DICT, pos - length};
+        stack.append(level);
+      } else if (info.kind == KIND_FIXED_LIST) {
+        Level level = {info.embedded, 0, false, pos - length};
+        stack.append(level);
+      } else if (info.kind == KIND_FIXED_DICT) {
+        Level level = {info.embedded * 2, 0, true, pos - length};
+        stack.append(level);
+      }
+    }
+    while (!stack.isEmpty() && stack.last().remaining == 0) stack.removeLast();
+  } while (!stack.isEmpty());
+  if (error == NoError) return pos;
+  if (result != NULL) {
+    result->error = error;
+    result->offset = pos;
+    result->typecode = pos < size ? quint8(data[pos]) : 0;
+  }
+  return -1;
+}
+
+void QtRencode::encode_char(QtRencodeBuffer *buf, signed char x) {
+  if (0 <= x && x < INT_POS_FIXED_COUNT) {
+    QTRENCODE_TRACE(INT_POS_FIXED_START + x, buf->size(), 0);
+    buf->put(INT_POS_FIXED_START + x);
+  } else if (-INT_NEG_FIXED_COUNT <= x && x < 0) {
+    QTRENCODE_TRACE(INT_NEG_FIXED_START - 1 - x, buf->size(), 0);
+    buf->put(INT_NEG_FIXED_START - 1 - x);
+  } else if (-128 <= x && x <= 127) {
+    QTRENCODE_TRACE(CHR_INT1, buf->size(), 1);
+    buf->put(CHR_INT1);
+    buf->put(x);
+  }
 }
 
-void QtRencode::encode_float64(char **buf, unsigned int *pos, double x) {
-  qDebug() << "---encode_float64---" << &buf << pos[0] << x;
-  write_buffer_char(buf, pos, CHR_FLOAT64);
-  if (!BIG_ENDIAN) x = swap_byte_order_double((char *)(&x));
-  write_buffer(buf, pos, &x, sizeof(x));
+void QtRencode::encode_short(QtRencodeBuffer *buf, short x) {
+  QTRENCODE_TRACE(CHR_INT2, buf->size(), 2);
+  char tmp[3] = {CHR_INT2};
+  qToBigEndian<qint16>(x, tmp + 1);
+  buf->write(tmp, sizeof(tmp));
 }
 
-void QtRencode::encode_str(char **buf, unsigned int *pos, QByteArray x) {
-  qDebug() << "---encode_str---" << &buf << pos[0] << x;
-  int lx = x.size();
+void QtRencode::encode_int(QtRencodeBuffer *buf, int x) {
+  QTRENCODE_TRACE(CHR_INT4, buf->size(), 4);
+  char tmp[5] = {CHR_INT4};
+  qToBigEndian<qint32>(x, tmp + 1);
+  buf->write(tmp, sizeof(tmp));
+}
+
+void QtRencode::encode_long_long(QtRencodeBuffer *buf, long long x) {
+  QTRENCODE_TRACE(CHR_INT8, buf->size(), 8);
+  char tmp[9] = {CHR_INT8};
+  qToBigEndian<qint64>(x, tmp + 1);
+  buf->write(tmp, sizeof(tmp));
+}
+
+void QtRencode::encode_integer(QtRencodeBuffer *buf, qlonglong x) {
+  if (-128 <= x && x < 128)
+    encode_char(buf, (signed char)x);
+  else if (-32768 <= x && x < 32768)
+    encode_short(buf, (short)x);
+  else if (MIN_SIGNED_INT <= x && x < MAX_SIGNED_INT)
+    encode_int(buf, (int)x);
+  else
+    encode_long_long(buf, x);
+}
+
+void QtRencode::encode_big_number(QtRencodeBuffer *buf, QByteArray &x) {
+  QTRENCODE_TRACE(CHR_INT, buf->size(), x.size());
+  buf->put(CHR_INT);
   char *d = x.data();
+  buf->write(d, x.size());
+  buf->put(CHR_TERM);
+}
+
+void QtRencode::encode_float32(QtRencodeBuffer *buf, float x) {
+  QTRENCODE_TRACE(CHR_FLOAT32, buf->size(), 4);
+  quint32 v;
+  memcpy(&v, &x, sizeof(v));
+  char tmp[5] = {CHR_FLOAT32};
+  qToBigEndian<quint32>(v, tmp + 1);
+  buf->write(tmp, sizeof(tmp));
+}
+
+void QtRencode::encode_float64(QtRencodeBuffer *buf, double x) {
+  QTRENCODE_TRACE(CHR_FLOAT64, buf->size(), 8);
+  quint64 v;
+  memcpy(&v, &x, sizeof(v));
+  char tmp[9] = {CHR_FLOAT64};
+  qToBigEndian<quint64>(v, tmp + 1);
+  buf->write(tmp, sizeof(tmp));
+}
+
+void QtRencode::encode_str_header(QtRencodeBuffer *buf, int lx) {
   if (lx < STR_FIXED_COUNT) {
-    write_buffer_char(buf, pos, STR_FIXED_START + lx);
-    write_buffer(buf, pos, d, lx);
+    QTRENCODE_TRACE(STR_FIXED_START + lx, buf->size(), lx);
+    buf->put(STR_FIXED_START + lx);
   } else {
     QString s = QString::number(lx) + ":";
     QByteArray tmp = s.toLatin1();
+    QTRENCODE_TRACE(tmp.at(0), buf->size(), lx);
     char *p = tmp.data();
-    write_buffer(buf, pos, p, tmp.size());
-    write_buffer(buf, pos, d, lx);
+    buf->write(p, tmp.size());
+  }
+}
+
+void QtRencode::encode_str(QtRencodeBuffer *buf, QByteArray x) {
+  if (buf->canReference(x.size())) {
+    encode_str_header(buf, x.size());
+    buf->reference(x);
+    return;
   }
+  encode_str(buf, x.constData(), x.size());
 }
 
-void QtRencode::encode_none(char **buf, unsigned int *pos) {
-  qDebug() << "---encode_none---" << &buf << pos[0] << "none";
-  write_buffer_char(buf, pos, CHR_NONE);
+void QtRencode::encode_str(QtRencodeBuffer *buf, const char *d, int lx) {
+  encode_str_header(buf, lx);
+  buf->write(d, lx);
 }
 
-void QtRencode::encode_bool(char **buf, unsigned int *pos, bool x) {
-  qDebug() << "---encode_bool---" << &buf << pos[0] << x;
+void QtRencode::encode_none(QtRencodeBuffer *buf) {
+  QTRENCODE_TRACE(CHR_NONE, buf->size(), 0);
+  buf->put(CHR_NONE);
+}
+
+void QtRencode::encode_bool(QtRencodeBuffer *buf, bool x) {
+  QTRENCODE_TRACE(x ? CHR_TRUE : CHR_FALSE, buf->size(), 0);
   if (x)
-    write_buffer_char(buf, pos, CHR_TRUE);
+    buf->put(CHR_TRUE);
   else
-    write_buffer_char(buf, pos, CHR_FALSE);
+    buf->put(CHR_FALSE);
+}
+
+void QtRencode::encode_number(QtRencodeBuffer *buf, qint32 x) {
+  encode_integer(buf, x);
+}
+
+void QtRencode::encode_number(QtRencodeBuffer *buf, qint64 x) {
+  encode_integer(buf, x);
+}
+
+void QtRencode::encode_number(QtRencodeBuffer *buf, float x) {
+  encode_float32(buf, x);
+}
+
+void QtRencode::encode_number(QtRencodeBuffer *buf, double x) {
+  encode_float64(buf, x);
+}
+
+template <typename T>
+QByteArray QtRencode::encode_array(const T *data, int size) {
+  // 每个元素最多为类型码加上自身的字节数，按qint64计算以免溢出，
+  // 超过上限的部分由缓冲区增长时报告OutputTooLarge
+  qint64 capacity = 2 + qint64(size) * qint64(1 + sizeof(T));
+  QtRencodeBuffer buf(int(qMin(capacity, qint64(QtRencodeBuffer::MAX_SIZE))));
+  bool fixed = size < LIST_FIXED_COUNT;
+  QTRENCODE_TRACE(fixed ? LIST_FIXED_START + size : CHR_LIST, 0, size);
+  buf.put(fixed ? LIST_FIXED_START + size : CHR_LIST);
+  if (std::is_floating_point<T>::value) {
+    // 浮点数的负载定长，先按块批量转成大端，再与类型码交错写入
+    const char typecode = sizeof(T) == 4 ? CHR_FLOAT32 : CHR_FLOAT64;
+    T block[BYTE_ORDER_BLOCK];
+    for (int i = 0; i < size; i += BYTE_ORDER_BLOCK) {
+      int n = qMin(size - i, BYTE_ORDER_BLOCK);
+      QtRencodeByteOrder::toBigEndian(data + i, block, n);
+      for (int j = 0; j < n; j++) {
+        QTRENCODE_TRACE(typecode, buf.size(), sizeof(T));
+        buf.put(typecode);
+        buf.write(block + j, sizeof(T));
+      }
+    }
+  } else {
+    for (int i = 0; i < size; i++) encode_number(&buf, data[i]);
+  }
+  if (!fixed) buf.put(CHR_TERM);
+  if (buf.failure() != NoError) return QByteArray();
+  return buf.take();
 }
 
-void QtRencode::encode_list(char **buf, unsigned int *pos,
-                            const QVariantList &x) {
-  qDebug() << "---encode_list---" << &buf << pos[0] << x;
+template <typename Container>
+bool QtRencode::decode_array(const QByteArray &data, Container *out) {
+  typedef typename Container::value_type T;
+  out->clear();
+  const char *p = data.constData();
+  const char *end = p + data.size();
+  if (p >= end) return false;
+  const TypeInfo &list = TYPE_TABLE[(quint8)*p++];
+  int count = -1;
+  if (list.kind == KIND_FIXED_LIST)
+    count = list.embedded;
+  else if (list.kind != KIND_LIST)
+    return false;
+  if (count >= 0) out->reserve(count);
+  // 与数组同宽的浮点数先收集负载，攒满一块后批量转换字节序
+  const quint8 native = sizeof(T) == 4 ? CHR_FLOAT32 : CHR_FLOAT64;
+  T block[BYTE_ORDER_BLOCK];
+  int pending = 0;
+  auto flush = [&]() {
+    QtRencodeByteOrder::fromBigEndian(block, block, pending);
+    for (int j = 0; j < pending; j++) out->push_back(block[j]);
+    pending = 0;
+  };
+  for (int i = 0; count < 0 || i < count; i++) {
+    if (p >= end) return false;
+    if (count < 0 && (quint8)*p == CHR_TERM) {
+      p++;
+      break;
+    }
+    if (std::is_floating_point<T>::value && (quint8)*p == native) {
+      if (end - p < int(1 + sizeof(T))) return false;
+      memcpy(block + pending, p + 1, sizeof(T));
+      p += 1 + sizeof(T);
+      if (++pending == BYTE_ORDER_BLOCK) flush();
+      continue;
+    }
+    if (pending > 0) flush();
+    const TypeInfo &info = TYPE_TABLE[(quint8)*p];
+    if (end - p < 1 + info.size) return false;
+    qint64 v = 0;
+    double d = 0;
+    bool real = false;
+    switch (info.kind) {
+      case KIND_FIXED_POS_INT:
+      case KIND_FIXED_NEG_INT:
+        v = info.embedded;
+        break;
+      case KIND_INT1:
+        v = (qint8)p[1];
+        break;
+      case KIND_INT2:
+        v = qFromBigEndian<qint16>(p + 1);
+        break;
+      case KIND_INT4:
+        v = qFromBigEndian<qint32>(p + 1);
+        break;
+      case KIND_INT8:
+        v = qFromBigEndian<qint64>(p + 1);
+        break;
+      case KIND_FLOAT32: {
+        quint32 bits = qFromBigEndian<quint32>(p + 1);
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        d = f;
+        real = true;
+        break;
+      }
+      case KIND_FLOAT64: {
+        quint64 bits = qFromBigEndian<quint64>(p + 1);
+        memcpy(&d, &bits, sizeof(d));
+        real = true;
+        break;
+      }
+      default:
+        return false;
+    }
+    if (std::is_integral<T>::value) {
+      if (real || v < qint64(std::numeric_limits<T>::min()) ||
+          v > qint64(std::numeric_limits<T>::max()))
+        return false;
+      out->push_back(T(v));
+    } else {
+      out->push_back(real ? T(d) : T(v));
+    }
+    p += 1 + info.size;
+  }
+  if (pending > 0) flush();
+  return p == end;
+}
+
+void QtRencode::encode_list(QtRencodeBuffer *buf, const QVariantList &x,
+                            const Options &options) {
   if (x.size() < LIST_FIXED_COUNT) {
-    write_buffer_char(buf, pos, LIST_FIXED_START + x.size());
-    for (QVariant i : x) encode(buf, pos, i);
+    QTRENCODE_TRACE(LIST_FIXED_START + x.size(), buf->size(), x.size());
+    buf->put(LIST_FIXED_START + x.size());
+    for (QVariant i : x) encode(buf, i, options);
   } else {
-    write_buffer_char(buf, pos, CHR_LIST);
-    for (QVariant i : x) encode(buf, pos, i);
-    write_buffer_char(buf, pos, CHR_TERM);
+    QTRENCODE_TRACE(CHR_LIST, buf->size(), x.size());
+    buf->put(CHR_LIST);
+    for (QVariant i : x) encode(buf, i, options);
+    buf->put(CHR_TERM);
   }
 }
 
-void QtRencode::encode_dict(char **buf, unsigned int *pos, const QVariant &x) {
-  qDebug() << "---encode_dict---" << &buf << pos[0] << x;
+void QtRencode::encode_dict(QtRencodeBuffer *buf, const QVariant &x,
+                            const Options &options) {
   QMap<QVariant, QVariant> map1 = x.value<QMap<QVariant, QVariant>>();
   if (map1.isEmpty())
-    encode_dict(buf, pos, x.toMap());
+    encode_dict(buf, x.toMap(), options);
   else
-    encode_dict(buf, pos, map1);
+    encode_dict(buf, map1, options);
 }
 
-void QtRencode::encode_dict(char **buf, unsigned int *pos,
-                            const QVariantMap &x) {
+void QtRencode::encode_dict(QtRencodeBuffer *buf, const QVariantMap &x,
+                            const Options &options) {
   if (x.size() < DICT_FIXED_COUNT) {
-    write_buffer_char(buf, pos, DICT_FIXED_START + x.size());
+    QTRENCODE_TRACE(DICT_FIXED_START + x.size(), buf->size(), x.size());
+    buf->put(DICT_FIXED_START + x.size());
     for (auto it = x.begin(); it != x.end(); it++) {
-      encode(buf, pos, it.key());
-      encode(buf, pos, it.value());
+      encode(buf, it.key(), options);
+      encode(buf, it.value(), options);
     }
   } else {
-    write_buffer_char(buf, pos, CHR_DICT);
+    QTRENCODE_TRACE(CHR_DICT, buf->size(), x.size());
+    buf->put(CHR_DICT);
     for (auto it = x.begin(); it != x.end(); it++) {
-      encode(buf, pos, it.key());
-      encode(buf, pos, it.value());
+      encode(buf, it.key(), options);
+      encode(buf, it.value(), options);
     }
-    write_buffer_char(buf, pos, CHR_TERM);
+    buf->put(CHR_TERM);
   }
 }
 
-void QtRencode::encode_dict(char **buf, unsigned int *pos,
-                            const QMap<QVariant, QVariant> &data) {
+void QtRencode::encode_dict(QtRencodeBuffer *buf,
+                            const QMap<QVariant, QVariant> &data,
+                            const Options &options) {
   if (data.size() < DICT_FIXED_COUNT) {
-    write_buffer_char(buf, pos, DICT_FIXED_START + data.size());
+    QTRENCODE_TRACE(DICT_FIXED_START + data.size(), buf->size(), data.size());
+    buf->put(DICT_FIXED_START + data.size());
     for (auto it = data.begin(); it != data.end(); it++) {
-      encode(buf, pos, it.key());
-      encode(buf, pos, it.value());
+      encode(buf, it.key(), options);
+      encode(buf, it.value(), options);
     }
   } else {
-    write_buffer_char(buf, pos, CHR_DICT);
+    QTRENCODE_TRACE(CHR_DICT, buf->size(), data.size());
+    buf->put(CHR_DICT);
     for (auto it = data.begin(); it != data.end(); it++) {
-      encode(buf, pos, it.key());
-      encode(buf, pos, it.value());
+      encode(buf, it.key(), options);
+      encode(buf, it.value(), options);
     }
-    write_buffer_char(buf, pos, CHR_TERM);
+    buf->put(CHR_TERM);
   }
 }
 
-void QtRencode::encode(char **buf, unsigned int *pos, const QVariant &data) {
+void QtRencode::encode(QtRencodeBuffer *buf, const QVariant &data,
+                       const Options &options) {
   if (data.type() == QVariant::List)
-    encode_list(buf, pos, data.toList());
+    encode_list(buf, data.toList(), options);
   else if (data.type() == QVariant::Map ||
            data.canConvert<QMap<QVariant, QVariant>>())
-    encode_dict(buf, pos, data);
+    encode_dict(buf, data, options);
   else if (data.type() == QVariant::Bool)
-    encode_bool(buf, pos, data.toBool());
+    encode_bool(buf, data.toBool());
   else if (data.type() == QVariant::String ||
            data.type() == QVariant::ByteArray) {
-    encode_str(buf, pos, data.toByteArray());
+    encode_str(buf, data.toByteArray());
   } else if (data.isNull())
-    encode_none(buf, pos);
+    encode_none(buf);
   else if (data.type() == QVariant::Double)
-    if (FLOAT_BITS == 32)
-      encode_float32(buf, pos, data.toFloat());
-    else if (FLOAT_BITS == 64)
-      encode_float64(buf, pos, data.toDouble());
-    else {
-      qCritical() << "Float bits (" << FLOAT_BITS << ") is not 32 or 64";
-      return;
-    }
+    if (options.floatBits == 32)
+      encode_float32(buf, data.toFloat());
+    else if (options.floatBits == 64)
+      encode_float64(buf, data.toDouble());
+    else
+      buf->fail(InvalidOption);
   else if (data.canConvert(QVariant::LongLong)) {
     // char short int float double long longlong
     qlonglong v = data.toLongLong();
-    if (-128 <= v && v < 128)
-      encode_char(buf, pos, data.value<qint8>());
-    else if (-32768 <= v && v < 32768)
-      encode_short(buf, pos, data.value<qint16>());
-    else if (MIN_SIGNED_INT <= v && v < MAX_SIGNED_INT)
-      encode_int(buf, pos, data.toInt());
-    else if (MIN_SIGNED_LONGLONG <= v && v < MAX_SIGNED_LONGLONG)
-      encode_long_long(buf, pos, v);
+    if (MIN_SIGNED_LONGLONG <= v && v < MAX_SIGNED_LONGLONG)
+      encode_integer(buf, v);
     else {
       QByteArray tmp = data.toByteArray();
       if (tmp.size() >= MAX_INT_LENGTH) {
-        qCritical() << "Number is longer than " << MAX_INT_LENGTH
-                    << " characters";
+        buf->fail(NumberTooLong);
         return;
       }
-      encode_big_number(buf, pos, tmp);
+      encode_big_number(buf, tmp);
     }
   } else
-    Q_ASSERT_X(
-        false, "encode",
-        QString("type %1 not handled").arg(data.typeName()).toUtf8().data());
+    buf->fail(UnsupportedType);
 }
 
-QVariant QtRencode::decode_char(const QByteArray &data, unsigned int *pos) {
+QVariant QtRencode::decode_char(const QByteArray &data, unsigned int *pos,
+                                DecodeContext *) {
   signed char c;
-  if (!check_pos(data, pos[0] + 1)) return NULL;
   const char *tmp = data.constData();
   memcpy(&c, &tmp[pos[0] + 1], 1);
   pos[0] += 2;
-  qDebug() << "---decode_char---" << pos[0] << c;
+  QTRENCODE_TRACE(CHR_INT1, pos[0] - 2, 1);
   return QVariant(c);
 }
 
-QVariant QtRencode::decode_short(const QByteArray &data, unsigned int *pos) {
-  short s;
-  if (!check_pos(data, pos[0] + 2)) return NULL;
-  const char *tmp = data.constData();
-  memcpy(&s, &tmp[pos[0] + 1], 2);
+QVariant QtRencode::decode_short(const QByteArray &data, unsigned int *pos,
+                                 DecodeContext *) {
+  short s = qFromBigEndian<qint16>(data.constData() + pos[0] + 1);
   pos[0] += 3;
-  if (!BIG_ENDIAN) s = swap_byte_order_short((char *)(&s));
-  qDebug() << "---decode_short---" << pos[0] << s;
+  QTRENCODE_TRACE(CHR_INT2, pos[0] - 3, 2);
   return QVariant(s);
 }
 
-QVariant QtRencode::decode_int(const QByteArray &data, unsigned int *pos) {
-  int i;
-  if (!check_pos(data, pos[0] + 4)) return NULL;
-  const char *tmp = data.constData();
-  memcpy(&i, &tmp[pos[0] + 1], 4);
+QVariant QtRencode::decode_int(const QByteArray &data, unsigned int *pos,
+                               DecodeContext *) {
+  int i = qFromBigEndian<qint32>(data.constData() + pos[0] + 1);
   pos[0] += 5;
-  if (!BIG_ENDIAN) i = swap_byte_order_int((char *)(&i));
-  qDebug() << "---decode_int---" << i << pos;
+  QTRENCODE_TRACE(CHR_INT4, pos[0] - 5, 4);
   return QVariant(i);
 }
 
-QVariant QtRencode::decode_long_long(const QByteArray &data,
-                                     unsigned int *pos) {
-  long long l;
-  if (!check_pos(data, pos[0] + 8)) return NULL;
-  const char *tmp = data.constData();
-  memcpy(&l, &tmp[pos[0] + 1], 8);
+QVariant QtRencode::decode_long_long(const QByteArray &data, unsigned int *pos,
+                                     DecodeContext *) {
+  long long l = qFromBigEndian<qint64>(data.constData() + pos[0] + 1);
   pos[0] += 9;
-  if (!BIG_ENDIAN) l = swap_byte_order_long_long((char *)(&l));
-  qDebug() << "---decode_long_long---" << pos[0] << l;
+  QTRENCODE_TRACE(CHR_INT8, pos[0] - 9, 8);
   return QVariant(l);
 }
 
 QVariant QtRencode::decode_fixed_pos_int(const QByteArray &data,
-                                         unsigned int *pos) {
+                                         unsigned int *pos, DecodeContext *) {
   pos[0] += 1;
   int v = data.at(pos[0] - 1) - INT_POS_FIXED_START;
-  qDebug() << "---decode_fixed_pos_int---" << pos[0] << v;
+  QTRENCODE_TRACE(data.at(pos[0] - 1), pos[0] - 1, 0);
   return QVariant(v);
 }
 
 QVariant QtRencode::decode_fixed_neg_int(const QByteArray &data,
-                                         unsigned int *pos) {
+                                         unsigned int *pos, DecodeContext *) {
   pos[0] += 1;
   int v = (data.at(pos[0] - 1) - INT_NEG_FIXED_START + 1) * -1;
-  qDebug() << "---decode_fixed_pos_int---" << pos[0] << v;
+  QTRENCODE_TRACE(data.at(pos[0] - 1), pos[0] - 1, 0);
   return (v);
 }
 
-QVariant QtRencode::decode_big_number(const QByteArray &data,
-                                      unsigned int *pos) {
-  pos[0] += 1;
-  int x = 18;
-  if (!check_pos(data, pos[0] + x)) return NULL;
-  while (data.at(pos[0] + x) != CHR_TERM) {
-    x += 1;
-    if (x >= MAX_INT_LENGTH) {
-      qCritical() << "Number is longer than " << MAX_INT_LENGTH
-                  << " characters";
-      return NULL;
-    }
-    if (!check_pos(data, pos[0] + x)) return NULL;
-  }
+QVariant QtRencode::decode_big_number(const QByteArray &data, unsigned int *pos,
+                                      DecodeContext *) {
+  int x = big_number_length(data, pos[0]);
   //  big_number = int(data[pos[0]:pos[0]+x]);
-  long long big_number = data.mid(pos[0], x).toLongLong();
-  pos[0] += x + 1;
-  qDebug() << "---decode_big_number---" << pos[0] << big_number;
+  long long big_number = data.mid(pos[0] + 1, x).toLongLong();
+  QTRENCODE_TRACE(CHR_INT, pos[0], x);
+  pos[0] += x + 2;
   return QVariant(big_number);
 }
 
-QVariant QtRencode::decode_float32(const QByteArray &data, unsigned int *pos) {
+QVariant QtRencode::decode_float32(const QByteArray &data, unsigned int *pos,
+                                   DecodeContext *) {
+  quint32 v = qFromBigEndian<quint32>(data.constData() + pos[0] + 1);
   float f;
-  if (!check_pos(data, pos[0] + 4)) return NULL;
-  const char *tmp = data.constData();
-  memcpy(&f, &tmp[pos[0] + 1], 4);
+  memcpy(&f, &v, sizeof(f));
   pos[0] += 5;
-  if (!BIG_ENDIAN) f = swap_byte_order_float((char *)(&f));
-  qDebug() << "---decode_float32---" << pos[0] << f;
+  QTRENCODE_TRACE(CHR_FLOAT32, pos[0] - 5, 4);
   return QVariant(f);
 }
 
-QVariant QtRencode::decode_float64(const QByteArray &data, unsigned int *pos) {
+QVariant QtRencode::decode_float64(const QByteArray &data, unsigned int *pos,
+                                   DecodeContext *) {
+  quint64 v = qFromBigEndian<quint64>(data.constData() + pos[0] + 1);
   double d;
-  if (!check_pos(data, pos[0] + 8)) return NULL;
-  const char *tmp = data.constData();
-  memcpy(&d, &tmp[pos[0] + 1], 8);
+  memcpy(&d, &v, sizeof(d));
   pos[0] += 9;
-  if (!BIG_ENDIAN) d = swap_byte_order_double((char *)(&d));
-  qDebug() << "---decode_float64---" << pos[0] << d;
+  QTRENCODE_TRACE(CHR_FLOAT64, pos[0] - 9, 8);
   return QVariant(d);
 }
 
-QVariant QtRencode::decode_fixed_str(const QByteArray &data,
-                                     unsigned int *pos) {
+/**
+ * @brief QtRencode::decode_text
+ * @param ctx
+ * @param s
+ * @return QString
+ * 与QTextCodec::codecForUtfText(s)->toUnicode(s)相同，但只有首字节可能是
+ * BOM时才检测编码，否则使用ctx中缓存的编码，省去每个字符串一次查找
+ */
+QString QtRencode::decode_text(DecodeContext *ctx, const QByteArray &s) {
+  if (!s.isEmpty()) {
+    quint8 c = s.at(0);
+    if (c == 0xEF || c == 0xFE || c == 0xFF || c == 0x00)
+      return QTextCodec::codecForUtfText(s)->toUnicode(s);
+  }
+  if (ctx->codec == NULL)
+    ctx->codec = QTextCodec::codecForUtfText(QByteArray());
+  return ctx->codec->toUnicode(s);
+}
+
+/**
+ * @brief QtRencode::decode_bytes
+ * @param data
+ * @param offset
+ * @param size
+ * @param ctx
+ * @return QVariant
+ * 取出data[offset, offset + size)处的字符串，json模式下转为QString，
+ * zeroCopy模式下直接引用输入数据而不复制
+ */
+QVariant QtRencode::decode_bytes(const QByteArray &data, unsigned int offset,
+                                 int size, DecodeContext *ctx) {
+  const Options &options = ctx->options;
+  QByteArray s = QByteArray::fromRawData(data.constData() + offset, size);
+  if (options.useJson) return decode_text(ctx, s);
+  if (options.zeroCopy) return QVariant(s);
+  return QVariant(data.mid(offset, size));
+}
+
+QVariant QtRencode::decode_fixed_str(const QByteArray &data, unsigned int *pos,
+                                     DecodeContext *ctx) {
   unsigned char size = data.at(pos[0]) - STR_FIXED_START;
-  if (!check_pos(data, pos[0] + size)) return NULL;
-  //  s = data [pos[0] + 1:pos[0] + size];
-  QByteArray s = data.mid(pos[0] + 1, size);
+  QTRENCODE_TRACE(STR_FIXED_START + size, pos[0], size);
   pos[0] += size + 1;
-  qDebug() << "---decode_fixed_str---" << pos[0] << s << USE_JSON;
-  if (USE_JSON) return QTextCodec::codecForUtfText(s)->toUnicode(s);
-  return QVariant(s);
+  return decode_bytes(data, pos[0] - size, size, ctx);
 }
 
-QVariant QtRencode::decode_str(const QByteArray &data, unsigned int *pos) {
-  unsigned int x = 1;
-  if (!check_pos(data, pos[0] + x)) return NULL;
-  while (data.at(pos[0] + x) != 58) {
-    x += 1;
-    if (!check_pos(data, pos[0] + x)) return NULL;
-  }
-
-  //  int size = int(data [pos[0]:pos[0] + x]);
-  int size = data.mid(pos[0], x).toInt();
-  pos[0] += x + 1;
-  if (!check_pos(data, pos[0] + size - 1)) return NULL;
-  //  s = data [pos[0]:pos[0] + size];
-  QByteArray s = data.mid(pos[0], size);
-  pos[0] += size;
-  qDebug() << "---decode_str---" << pos[0] << s << USE_JSON;
-  if (USE_JSON) return QTextCodec::codecForUtfText(s)->toUnicode(s);
-  return QVariant(s);
+QVariant QtRencode::decode_str(const QByteArray &data, unsigned int *pos,
+                               DecodeContext *ctx) {
+  int size, x;
+  read_str_header(data, pos[0], &size, &x);
+  if (size > ctx->limits.maxStringLength)
+    return decode_error(ctx, StringLimitExceeded, pos[0]);
+  pos[0] += x + 1 + size;
+  QTRENCODE_TRACE(data.at(pos[0] - size - x - 1), pos[0] - size - x - 1, size);
+  return decode_bytes(data, pos[0] - size, size, ctx);
 }
 
-QVariantList QtRencode::decode_fixed_list(const QByteArray &data,
-                                          unsigned int *pos) {
-  qDebug() << "---decode_fixed_list---" << pos[0];
+QVariant QtRencode::decode_fixed_list(const QByteArray &data, unsigned int *pos,
+                                      DecodeContext *ctx) {
   QVariantList l;
   unsigned char size = (unsigned char)data.at(pos[0]) - LIST_FIXED_START;
+  if (size > ctx->limits.maxContainerSize)
+    return decode_error(ctx, ContainerLimitExceeded, pos[0]);
+  if (ctx->depth >= ctx->limits.maxDepth)
+    return decode_error(ctx, DepthLimitExceeded, pos[0]);
+  QTRENCODE_TRACE(LIST_FIXED_START + size, pos[0], size);
   pos[0] += 1;
-  if (data.size() < size) return l;
-  for (unsigned char i = 0; i < size; i++) l.append(decode(data, pos));
-  qDebug() << "---decode_fixed_list---" << pos[0] << l;
+  ctx->depth++;
+  l.reserve(size);
+  for (unsigned char i = 0; i < size; i++) {
+    l.append(decode(data, pos, ctx));
+    if (ctx->error != NoError) return QVariant();
+  }
+  ctx->depth--;
   return l;
 }
 
-QVariantList QtRencode::decode_list(const QByteArray &data, unsigned int *pos) {
-  qDebug() << "---decode_list---" << pos[0];
+QVariant QtRencode::decode_list(const QByteArray &data, unsigned int *pos,
+                                DecodeContext *ctx) {
+  unsigned int start = pos[0];
   QVariantList l;
+  if (ctx->depth >= ctx->limits.maxDepth)
+    return decode_error(ctx, DepthLimitExceeded, pos[0]);
   pos[0] += 1;
-  while (data.at(pos[0]) != CHR_TERM) l.append(decode(data, pos));
+  ctx->depth++;
+  while (true) {
+    if (pos[0] >= (unsigned int)data.size())
+      return decode_error(ctx, TruncatedData, pos[0]);
+    if (data.at(pos[0]) == CHR_TERM) break;
+    if (l.size() >= ctx->limits.maxContainerSize)
+      return decode_error(ctx, ContainerLimitExceeded, start);
+    l.append(decode(data, pos, ctx));
+    if (ctx->error != NoError) return QVariant();
+  }
   pos[0] += 1;
-  qDebug() << "---decode_list---" << pos[0] << l;
+  ctx->depth--;
+  QTRENCODE_TRACE(CHR_LIST, start, l.size());
   return l;
 }
 
-QVariant QtRencode::decode_fixed_dict(const QByteArray &data,
-                                      unsigned int *pos) {
-  qDebug() << "---decode_fixed_dict---" << pos[0];
+/**
+ * @brief QtRencode::cached_key
+ * @param data
+ * @param pos
+ * @param ctx
+ * @param key
+ * @param raw 使用缓存且pos处是字符串时为其原始字节，未命中时由调用者加入缓存
+ * @return bool
+ * pos处是字符串且已在Options::keyCache中时取出缓存的键并前进，
+ * 与decode一样计入节点数并检查上限；否则不前进并返回false
+ */
+bool QtRencode::cached_key(const QByteArray &data, unsigned int *pos,
+                           DecodeContext *ctx, QString *key, QByteArray *raw) {
+  QtRencodeKeyCache *cache = ctx->options.keyCache;
+  if (cache == NULL) return false;
+  qint64 length = token_length(data.constData(), data.size(), pos[0]);
+  if (length <= 0) return false;
+  const TypeInfo &info = TYPE_TABLE[(quint8)data.at(pos[0])];
+  int size;
+  if (info.kind == KIND_FIXED_STR) {
+    size = info.size;
+  } else if (info.kind == KIND_STR) {
+    int x;
+    read_str_header(data, pos[0], &size, &x);
+  } else {
+    return false;
+  }
+  raw[0] = QByteArray::fromRawData(data.constData() + pos[0] + length - size,
+                                   size);
+  if (size > ctx->limits.maxStringLength ||
+      ctx->nodes >= ctx->limits.maxNodes || !cache->find(raw[0], key))
+    return false;
+  QTRENCODE_TRACE(data.at(pos[0]), pos[0], size);
+  ctx->nodes++;
+  pos[0] += length;
+  return true;
+}
+
+/**
+ * @brief QtRencode::decode_pair
+ * @param data
+ * @param pos
+ * @param ctx
+ * @param json json模式下插入到这里
+ * @param map 否则插入到这里
+ * 解码字典中的一个键值对
+ */
+void QtRencode::decode_pair(const QByteArray &data, unsigned int *pos,
+                            DecodeContext *ctx, QVariantMap *json,
+                            QMap<QVariant, QVariant> *map) {
+  if (ctx->options.useJson) {
+    QString key;
+    QByteArray raw;
+    if (!cached_key(data, pos, ctx, &key, &raw)) {
+      QByteArray tmp = decode(data, pos, ctx).toByteArray();
+      key = decode_text(ctx, tmp);
+      if (!raw.isNull() && ctx->error == NoError)
+        ctx->options.keyCache->insert(raw, key);
+    }
+    QVariant value = decode(data, pos, ctx);
+    json->insert(key, value);
+  } else {
+    QVariant key = decode(data, pos, ctx);
+    QVariant value = decode(data, pos, ctx);
+    map->insert(key, value);
+  }
+}
+
+QVariant QtRencode::decode_fixed_dict(const QByteArray &data, unsigned int *pos,
+                                      DecodeContext *ctx) {
   QVariantMap json_ret;
   QMap<QVariant, QVariant> map_ret;
+  const Options &options = ctx->options;
   unsigned char size = (unsigned char)data.at(pos[0]) - DICT_FIXED_START;
+  if (size > ctx->limits.maxContainerSize)
+    return decode_error(ctx, ContainerLimitExceeded, pos[0]);
+  if (ctx->depth >= ctx->limits.maxDepth)
+    return decode_error(ctx, DepthLimitExceeded, pos[0]);
+  QTRENCODE_TRACE(DICT_FIXED_START + size, pos[0], size);
   pos[0] += 1;
+  ctx->depth++;
   for (unsigned char i = 0; i < size; i++) {
-    if (USE_JSON) {
-      QByteArray tmp = decode(data, pos).toByteArray();
-      QString key = QTextCodec::codecForUtfText(tmp)->toUnicode(tmp);
-      QVariant value = decode(data, pos);
-      json_ret.insert(key, value);
-    } else {
-      QVariant key = decode(data, pos);
-      QVariant value = decode(data, pos);
-      map_ret.insert(key, value);
-    }
+    decode_pair(data, pos, ctx, &json_ret, &map_ret);
+    if (ctx->error != NoError) return QVariant();
   }
-  if (USE_JSON) {
-    qDebug() << "---decode_fixed_dict---" << pos[0] << json_ret;
+  ctx->depth--;
+  if (options.useJson)
     return json_ret;
-  } else {
-    qDebug() << "---decode_fixed_dict---" << pos[0] << map_ret;
+  else
     return QVariant::fromValue<QMap<QVariant, QVariant>>(map_ret);
-  }
 }
 
-QVariant QtRencode::decode_dict(const QByteArray &data, unsigned int *pos) {
-  qDebug() << "---decode_dict---" << pos[0];
+QVariant QtRencode::decode_dict(const QByteArray &data, unsigned int *pos,
+                                DecodeContext *ctx) {
+  unsigned int start = pos[0];
   QVariantMap json_ret;
   QMap<QVariant, QVariant> map_ret;
+  const Options &options = ctx->options;
+  // 重复的键会被覆盖，因此另行计数
+  int count = 0;
+  if (ctx->depth >= ctx->limits.maxDepth)
+    return decode_error(ctx, DepthLimitExceeded, pos[0]);
   pos[0] += 1;
-  if (!check_pos(data, pos[0])) return NULL;
-  while (data.at(pos[0]) != CHR_TERM) {
-    if (USE_JSON) {
-      QByteArray tmp = decode(data, pos).toByteArray();
-      QString key = QTextCodec::codecForUtfText(tmp)->toUnicode(tmp);
-      QVariant value = decode(data, pos);
-      json_ret.insert(key, value);
-    } else {
-      QVariant key = decode(data, pos);
-      QVariant value = decode(data, pos);
-      map_ret.insert(key, value);
-    }
+  ctx->depth++;
+  while (true) {
+    if (pos[0] >= (unsigned int)data.size())
+      return decode_error(ctx, TruncatedData, pos[0]);
+    if (data.at(pos[0]) == CHR_TERM) break;
+    if (count++ >= ctx->limits.maxContainerSize)
+      return decode_error(ctx, ContainerLimitExceeded, start);
+    decode_pair(data, pos, ctx, &json_ret, &map_ret);
+    if (ctx->error != NoError) return QVariant();
   }
   pos[0] += 1;
-  if (USE_JSON) {
-    qDebug() << "---decode_fixed_dict---" << pos[0] << json_ret;
+  ctx->depth--;
+  if (options.useJson) {
+    QTRENCODE_TRACE(CHR_DICT, start, json_ret.size());
     return json_ret;
   } else {
-    qDebug() << "---decode_fixed_dict---" << pos[0] << map_ret;
+    QTRENCODE_TRACE(CHR_DICT, start, map_ret.size());
     return QVariant::fromValue<QMap<QVariant, QVariant>>(map_ret);
   }
 }
 
-QVariant QtRencode::decode(const QByteArray &data, unsigned int *pos) {
-  if (pos[0] >= (unsigned int)data.size()) {
-    qCritical() << "Malformed rencoded string: data_length: " << data.size()
-                << " pos: " << pos[0];
-    return NULL;
-  }
-  unsigned char typecode = data[pos[0]];
-  if (typecode == CHR_INT1)
-    return decode_char(data, pos);
-  else if (typecode == CHR_INT2)
-    return decode_short(data, pos);
-  else if (typecode == CHR_INT4)
-    return decode_int(data, pos);
-  else if (typecode == CHR_INT8)
-    return decode_long_long(data, pos);
-  else if (INT_POS_FIXED_START <= typecode &&
-           typecode < INT_POS_FIXED_START + INT_POS_FIXED_COUNT)
-    return decode_fixed_pos_int(data, pos);
-  else if (INT_NEG_FIXED_START <= typecode &&
-           typecode < INT_NEG_FIXED_START + INT_NEG_FIXED_COUNT)
-    return decode_fixed_neg_int(data, pos);
-  else if (typecode == CHR_INT &&
-           data.indexOf(CHR_TERM, (int)pos[0]) > (int)pos[0])
-    return decode_big_number(data, pos);
-  else if (typecode == CHR_FLOAT32)
-    return decode_float32(data, pos);
-  else if (typecode == CHR_FLOAT64)
-    return decode_float64(data, pos);
-  else if (STR_FIXED_START <= typecode &&
-           typecode < STR_FIXED_START + STR_FIXED_COUNT)
-    return decode_fixed_str(data, pos);
-  else if (49 <= typecode && typecode <= 57 &&
-           data.indexOf(":", (int)pos[0]) > (int)pos[0])
-    return decode_str(data, pos);
-  else if (typecode == CHR_NONE) {
-    pos[0] += 1;
-    return QVariant();
-  } else if (typecode == CHR_TRUE) {
-    pos[0] += 1;
+QVariant QtRencode::decode_none(const QByteArray &, unsigned int *pos,
+                                DecodeContext *) {
+  QTRENCODE_TRACE(CHR_NONE, pos[0], 0);
+  pos[0] += 1;
+  return QVariant();
+}
+
+QVariant QtRencode::decode_bool(const QByteArray &data, unsigned int *pos,
+                                DecodeContext *) {
+  bool b = (quint8)data.at(pos[0]) == CHR_TRUE;
+  QTRENCODE_TRACE(data.at(pos[0]), pos[0], 0);
+  pos[0] += 1;
+  return b;
+}
+
+QVariant QtRencode::decode_invalid(const QByteArray &, unsigned int *pos,
+                                   DecodeContext *ctx) {
+  return decode_error(ctx, InvalidTypecode, pos[0]);
+}
+
+/**
+ * @brief QtRencode::decode_error
+ * @param ctx
+ * @param error
+ * @param pos
+ * @return QVariant
+ * 记录第一个错误及其位置，返回空值
+ */
+QVariant QtRencode::decode_error(DecodeContext *ctx, Error error,
+                                 unsigned int pos) {
+  if (ctx->error == NoError) {
+    ctx->error = error;
+    ctx->errorOffset = pos;
+  }
+  return QVariant();
+}
+
+/**
+ * @brief QtRencode::type_info
+ * @param c
+ * @return TypeInfo
+ * 类型码对应的解码函数及定长信息，在编译期展开成TYPE_TABLE
+ */
+constexpr QtRencode::TypeInfo QtRencode::type_info(int c) {
+  return c < INT_POS_FIXED_START + INT_POS_FIXED_COUNT
+             ? TypeInfo{KIND_FIXED_POS_INT, 0, qint8(c - INT_POS_FIXED_START),
+                        &decode_fixed_pos_int}
+         : c == CHR_FLOAT64
+             ? TypeInfo{KIND_FLOAT64, 8, 0, &decode_float64}
+         : 49 <= c && c <= 57
+             ? TypeInfo{KIND_STR, 0, 0, &decode_str}
+         : c == CHR_LIST ? TypeInfo{KIND_LIST, 0, 0, &decode_list}
+         : c == CHR_DICT ? TypeInfo{KIND_DICT, 0, 0, &decode_dict}
+         : c == CHR_INT ? TypeInfo{KIND_BIG_NUMBER, 0, 0, &decode_big_number}
+         : c == CHR_INT1 ? TypeInfo{KIND_INT1, 1, 0, &decode_char}
+         : c == CHR_INT2 ? TypeInfo{KIND_INT2, 2, 0, &decode_short}
+         : c == CHR_INT4 ? TypeInfo{KIND_INT4, 4, 0, &decode_int}
+         : c == CHR_INT8 ? TypeInfo{KIND_INT8, 8, 0, &decode_long_long}
+         : c == CHR_FLOAT32 ? TypeInfo{KIND_FLOAT32, 4, 0, &decode_float32}
+         : c == CHR_TRUE ? TypeInfo{KIND_TRUE, 0, 0, &decode_bool}
+         : c == CHR_FALSE ? TypeInfo{KIND_FALSE, 0, 0, &decode_bool}
+         : c == CHR_NONE ? TypeInfo{KIND_NONE, 0, 0, &decode_none}
+         : INT_NEG_FIXED_START <= c &&
+                 c < INT_NEG_FIXED_START + INT_NEG_FIXED_COUNT
+             ? TypeInfo{KIND_FIXED_NEG_INT, 0,
+                        qint8(INT_NEG_FIXED_START - 1 - c),
+                        &decode_fixed_neg_int}
+         : DICT_FIXED_START <= c && c < DICT_FIXED_START + DICT_FIXED_COUNT
+             ? TypeInfo{KIND_FIXED_DICT, 0, qint8(c - DICT_FIXED_START),
+                        &decode_fixed_dict}
+         : STR_FIXED_START <= c && c < STR_FIXED_START + STR_FIXED_COUNT
+             ? TypeInfo{KIND_FIXED_STR, quint8(c - STR_FIXED_START), 0,
+                        &decode_fixed_str}
+         : LIST_FIXED_START <= c && c < LIST_FIXED_START + LIST_FIXED_COUNT
+             ? TypeInfo{KIND_FIXED_LIST, 0, qint8(c - LIST_FIXED_START),
+                        &decode_fixed_list}
+             : TypeInfo{KIND_INVALID, 0, 0, &decode_invalid};
+}
+
+#define QTRENCODE_TYPE_INFO_4(c) \
+  type_info(c), type_info(c + 1), type_info(c + 2), type_info(c + 3)
+#define QTRENCODE_TYPE_INFO_16(c)                         \
+  QTRENCODE_TYPE_INFO_4(c), QTRENCODE_TYPE_INFO_4(c + 4), \
+      QTRENCODE_TYPE_INFO_4(c + 8), QTRENCODE_TYPE_INFO_4(c + 12)
+#define QTRENCODE_TYPE_INFO_64(c)                            \
+  QTRENCODE_TYPE_INFO_16(c), QTRENCODE_TYPE_INFO_16(c + 16), \
+      QTRENCODE_TYPE_INFO_16(c + 32), QTRENCODE_TYPE_INFO_16(c + 48)
+
+const QtRencode::TypeInfo QtRencode::TYPE_TABLE[256] = {
+    QTRENCODE_TYPE_INFO_64(0), QTRENCODE_TYPE_INFO_64(64),
+    QTRENCODE_TYPE_INFO_64(128), QTRENCODE_TYPE_INFO_64(192)};
+
+/**
+ * @brief QtRencode::decode
+ * @param data
+ * @param pos
+ * @param ctx
+ * @return QVariant
+ * 解码pos处的一个值。先按类型码确认整个记号都在数据内，解码函数不再逐字节
+ * 检查边界；出错时记录在ctx中并返回空值，外层容器随即停止
+ */
+QVariant QtRencode::decode(const QByteArray &data, unsigned int *pos,
+                           DecodeContext *ctx) {
+  qint64 length = token_length(data.constData(), data.size(), pos[0]);
+  if (Q_UNLIKELY(length <= 0)) {
+    if (length == 0) return decode_error(ctx, TruncatedData, pos[0]);
+    const TypeInfo &info = TYPE_TABLE[(quint8)data.at(pos[0])];
+    return decode_error(
+        ctx, info.kind == KIND_INVALID ? InvalidTypecode : MalformedData,
+        pos[0]);
+  }
+  if (Q_UNLIKELY(++ctx->nodes > ctx->limits.maxNodes))
+    return decode_error(ctx, NodeLimitExceeded, pos[0]);
+  const TypeInfo &info = TYPE_TABLE[(quint8)data.at(pos[0])];
+  if (Q_UNLIKELY(info.size > ctx->limits.maxStringLength &&
+                 info.kind == KIND_FIXED_STR))
+    return decode_error(ctx, StringLimitExceeded, pos[0]);
+  return info.decoder(data, pos, ctx);
+}
+
+QVariant QtRencode::decode(const QByteArray &data, unsigned int *pos,
+                           const Options &options) {
+  Limits limits;
+  DecodeContext ctx = {options, limits, 0, 0, NoError, 0, NULL};
+  return decode(data, pos, &ctx);
+}
+
+/**
+ * @brief QtRencode::parse
+ * @param data
+ * @param visitor
+ * @param pos 起始位置，解析后更新为该值之后的位置，为NULL时从0开始
+ * @param maxDepth 列表、字典的最大嵌套层数
+ * @return bool
+ * 事件式解码一个值，数据格式错误或嵌套超过maxDepth层时返回false，
+ * 回调要求停止时返回true
+ */
+bool QtRencode::parse(const QByteArray &data, QtRencodeVisitor *visitor,
+                      unsigned int *pos, int maxDepth) {
+  unsigned int start = 0;
+  if (pos == NULL) pos = &start;
+  return parse_value(data, pos, visitor, maxDepth) != PARSE_ERROR;
+}
+
+/**
+ * @brief QtRencode::skipValue
+ * @param data
+ * @param pos
+ * @param result 不为NULL时填入出错的原因和位置，成功时为NoError
+ * @return qint64
+ * 跳过pos处的一个完整值，返回其后的位置，数据不完整或格式错误时返回-1。
+ * pos为负数时与超出数据末尾一样按TruncatedData报告
+ */
+qint64 QtRencode::skipValue(const QByteArray &data, qint64 pos,
+                            Result *result) {
+  if (result != NULL) *result = Result();
+  if (pos < 0) {
+    if (result != NULL) {
+      result->error = TruncatedData;
+      result->offset = pos;
+    }
+    return -1;
+  }
+  return skip_value(data.constData(), data.size(), pos, NULL, result);
+}
+
+/**
+ * @brief QtRencode::validate
+ * @param data
+ * @param limits
+ * @return Result
+ * 不解码地检查data是否恰好是一个格式正确且不超出上限的值，
+ * 错误与loads一样通过Result报告
+ */
+QtRencode::Result QtRencode::validate(const QByteArray &data,
+                                      const Limits &limits) {
+  Result result;
+  qint64 end = skip_value(data.constData(), data.size(), 0, &limits, &result);
+  if (end >= 0 && end != data.size()) {
+    result.error = MalformedData;
+    result.offset = end;
+    result.typecode = data.at(int(end));
+  }
+  return result;
+}
+
+// depth为还允许嵌套的容器层数，每进入一层列表或字典减一
+QtRencode::ParseState QtRencode::parse_value(const QByteArray &data,
+                                             unsigned int *pos,
+                                             QtRencodeVisitor *visitor,
+                                             int depth) {
+  if (!check_pos(data, pos[0])) return PARSE_ERROR;
+  const char *p = data.constData() + pos[0];
+  const TypeInfo &info = TYPE_TABLE[(quint8)p[0]];
+  if (info.size > 0 && !check_pos(data, pos[0] + info.size))
+    return PARSE_ERROR;
+  bool more = true;
+  switch (info.kind) {
+    case KIND_FIXED_POS_INT:
+    case KIND_FIXED_NEG_INT:
+      more = visitor->onInt(info.embedded);
+      pos[0] += 1;
+      break;
+    case KIND_INT1:
+      more = visitor->onInt((qint8)p[1]);
+      pos[0] += 2;
+      break;
+    case KIND_INT2:
+      more = visitor->onInt(qFromBigEndian<qint16>(p + 1));
+      pos[0] += 3;
+      break;
+    case KIND_INT4:
+      more = visitor->onInt(qFromBigEndian<qint32>(p + 1));
+      pos[0] += 5;
+      break;
+    case KIND_INT8:
+      more = visitor->onInt(qFromBigEndian<qint64>(p + 1));
+      pos[0] += 9;
+      break;
+    case KIND_BIG_NUMBER: {
+      int x = big_number_length(data, pos[0]);
+      if (x < 0) return PARSE_ERROR;
+      more = visitor->onInt(data.mid(pos[0] + 1, x).toLongLong());
+      pos[0] += x + 2;
+      break;
+    }
+    case KIND_FLOAT32: {
+      quint32 v = qFromBigEndian<quint32>(p + 1);
+      float f;
+      memcpy(&f, &v, sizeof(f));
+      more = visitor->onFloat(f);
+      pos[0] += 5;
+      break;
+    }
+    case KIND_FLOAT64: {
+      quint64 v = qFromBigEndian<quint64>(p + 1);
+      double d;
+      memcpy(&d, &v, sizeof(d));
+      more = visitor->onFloat(d);
+      pos[0] += 9;
+      break;
+    }
+    case KIND_FIXED_STR:
+      more = visitor->onString(QByteArray::fromRawData(p + 1, info.size));
+      pos[0] += info.size + 1;
+      break;
+    case KIND_STR: {
+      int size, x;
+      if (!read_str_header(data, pos[0], &size, &x)) return PARSE_ERROR;
+      if (size > 0 && !check_pos(data, pos[0] + x + size)) return PARSE_ERROR;
+      more = visitor->onString(QByteArray::fromRawData(p + x + 1, size));
+      pos[0] += x + 1 + size;
+      break;
+    }
+    case KIND_NONE:
+      more = visitor->onNone();
+      pos[0] += 1;
+      break;
+    case KIND_TRUE:
+    case KIND_FALSE:
+      more = visitor->onBool(info.kind == KIND_TRUE);
+      pos[0] += 1;
+      break;
+    case KIND_FIXED_LIST:
+    case KIND_LIST: {
+      bool fixed = info.kind == KIND_FIXED_LIST;
+      if (depth <= 0) return PARSE_ERROR;
+      if (!visitor->beginList(fixed ? info.embedded : -1)) return PARSE_STOP;
+      pos[0] += 1;
+      for (int i = 0; !fixed || i < info.embedded; i++) {
+        if (!fixed) {
+          if (!check_pos(data, pos[0])) return PARSE_ERROR;
+          if ((quint8)data.at(pos[0]) == CHR_TERM) {
+            pos[0] += 1;
+            break;
+          }
+        }
+        ParseState state = parse_value(data, pos, visitor, depth - 1);
+        if (state != PARSE_CONTINUE) return state;
+      }
+      more = visitor->endList();
+      break;
+    }
+    case KIND_FIXED_DICT:
+    case KIND_DICT: {
+      bool fixed = info.kind == KIND_FIXED_DICT;
+      if (depth <= 0) return PARSE_ERROR;
+      if (!visitor->beginDict(fixed ? info.embedded : -1)) return PARSE_STOP;
+      pos[0] += 1;
+      for (int i = 0; !fixed || i < info.embedded; i++) {
+        if (!check_pos(data, pos[0])) return PARSE_ERROR;
+        const char *k = data.constData() + pos[0];
+        quint8 kind = TYPE_TABLE[(quint8)k[0]].kind;
+        if (!fixed && (quint8)k[0] == CHR_TERM) {
+          pos[0] += 1;
+          break;
+        }
+        if (kind == KIND_FIXED_STR) {
+          int size = TYPE_TABLE[(quint8)k[0]].size;
+          if (size > 0 && !check_pos(data, pos[0] + size)) return PARSE_ERROR;
+          if (!visitor->key(QByteArray::fromRawData(k + 1, size)))
+            return PARSE_STOP;
+          pos[0] += size + 1;
+        } else if (kind == KIND_STR) {
+          int size, x;
+          if (!read_str_header(data, pos[0], &size, &x)) return PARSE_ERROR;
+          if (size > 0 && !check_pos(data, pos[0] + x + size))
+            return PARSE_ERROR;
+          if (!visitor->key(QByteArray::fromRawData(k + x + 1, size)))
+            return PARSE_STOP;
+          pos[0] += x + 1 + size;
+        } else {
+          ParseState state = parse_value(data, pos, visitor, depth - 1);
+          if (state != PARSE_CONTINUE) return state;
+        }
+        ParseState state = parse_value(data, pos, visitor, depth - 1);
+        if (state != PARSE_CONTINUE) return state;
+      }
+      more = visitor->endDict();
+      break;
+    }
+    default:
+      return PARSE_ERROR;
+  }
+  return more ? PARSE_CONTINUE : PARSE_STOP;
+}
+
+/**
+ * @brief QtRencode::fromJson
+ * @param json
+ * @param options
+ * @param errorOffset 出错位置，成功时为-1
+ * @return QByteArray
+ * 单遍把json文本直接转成rencode，不构造QJsonDocument和QVariant。
+ * 不带小数点和指数的数字编码为整数，对象的键保持原有顺序，出错时返回空
+ */
+QByteArray QtRencode::fromJson(const QByteArray &json, const Options &options,
+                               int *errorOffset) {
+  QtRencodeBuffer buf(json.size());
+  const char *begin = json.constData();
+  const char *end = begin + json.size();
+  const char *p = begin;
+  bool ok = json_value(&p, end, &buf, options);
+  if (ok) {
+    p = skip_space(p, end);
+    ok = p == end;
+  }
+  if (errorOffset != NULL) errorOffset[0] = ok ? -1 : int(p - begin);
+  return ok ? buf.take() : QByteArray();
+}
+
+bool QtRencode::json_string(const char **p, const char *end,
+                            QtRencodeBuffer *buf, QByteArray *scratch) {
+  // p指向起始的引号，没有转义字符时直接从输入复制
+  const char *start = p[0] + 1;
+  const char *q = start;
+  while (q < end && *q != '"' && *q != '\\' && (quint8)*q >= 0x20) q++;
+  if (q < end && *q == '"') {
+    encode_str(buf, start, int(q - start));
+    p[0] = q + 1;
     return true;
-  } else if (typecode == CHR_FALSE) {
-    pos[0] += 1;
+  }
+  scratch->clear();
+  scratch->append(start, int(q - start));
+  while (q < end && *q != '"' && (quint8)*q >= 0x20) {
+    if (*q != '\\') {
+      scratch->append(*q++);
+      continue;
+    }
+    if (++q >= end) break;
+    switch (*q++) {
+      case '"':
+        scratch->append('"');
+        break;
+      case '\\':
+        scratch->append('\\');
+        break;
+      case '/':
+        scratch->append('/');
+        break;
+      case 'b':
+        scratch->append('\b');
+        break;
+      case 'f':
+        scratch->append('\f');
+        break;
+      case 'n':
+        scratch->append('\n');
+        break;
+      case 'r':
+        scratch->append('\r');
+        break;
+      case 't':
+        scratch->append('\t');
+        break;
+      case 'u': {
+        int u = hex4(q, end);
+        if (u < 0) {
+          p[0] = q;
+          return false;
+        }
+        q += 4;
+        uint ucs4 = u;
+        if (QChar::isHighSurrogate(ucs4)) {
+          int low = end - q >= 6 && q[0] == '\\' && q[1] == 'u'
+                        ? hex4(q + 2, end)
+                        : -1;
+          if (low >= 0 && QChar::isLowSurrogate(low)) {
+            ucs4 = QChar::surrogateToUcs4(ucs4, low);
+            q += 6;
+          }
+        }
+        // 不成对的代理项替换为U+FFFD
+        if (QChar::isSurrogate(ucs4)) ucs4 = QChar::ReplacementCharacter;
+        append_utf8(scratch, ucs4);
+        break;
+      }
+      default:
+        p[0] = q - 1;
+        return false;
+    }
+  }
+  if (q >= end || *q != '"') {
+    p[0] = q;
     return false;
-  } else if (LIST_FIXED_START <= typecode &&
-             typecode <= LIST_FIXED_START + LIST_FIXED_COUNT - 1)
-    return decode_fixed_list(data, pos);
-  else if (typecode == CHR_LIST &&
-           data.indexOf(CHR_TERM, (int)pos[0]) > (int)pos[0])
-    return decode_list(data, pos);
-  else if (DICT_FIXED_START <= typecode &&
-           typecode < DICT_FIXED_START + DICT_FIXED_COUNT)
-    return decode_fixed_dict(data, pos);
-  else if (typecode == CHR_DICT &&
-           data.indexOf(CHR_TERM, (int)pos[0]) > (int)pos[0])
-    return decode_dict(data, pos);
-  qCritical() << "Unknow typecode: " << typecode;
-  return NULL;
+  }
+  encode_str(buf, scratch->constData(), scratch->size());
+  p[0] = q + 1;
+  return true;
+}
+
+bool QtRencode::json_key(const char **p, const char *end, QtRencodeBuffer *buf,
+                         QByteArray *scratch) {
+  if (p[0] >= end || *p[0] != '"' || !json_string(p, end, buf, scratch))
+    return false;
+  const char *q = skip_space(p[0], end);
+  if (q >= end || *q != ':') {
+    p[0] = q;
+    return false;
+  }
+  p[0] = skip_space(q + 1, end);
+  return true;
+}
+
+bool QtRencode::json_literal(const char **p, const char *end,
+                             QtRencodeBuffer *buf) {
+  const char *q = p[0];
+  if (end - q >= 4 && memcmp(q, "null", 4) == 0) {
+    encode_none(buf);
+    p[0] = q + 4;
+  } else if (end - q >= 4 && memcmp(q, "true", 4) == 0) {
+    encode_bool(buf, true);
+    p[0] = q + 4;
+  } else if (end - q >= 5 && memcmp(q, "false", 5) == 0) {
+    encode_bool(buf, false);
+    p[0] = q + 5;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool QtRencode::json_number(const char **p, const char *end,
+                            QtRencodeBuffer *buf, const Options &options) {
+  const char *start = p[0];
+  const char *q = start;
+  bool negative = q < end && *q == '-';
+  if (negative) q++;
+  if (q >= end || *q < '0' || *q > '9') {
+    p[0] = q;
+    return false;
+  }
+  // 整数部分，同时累加绝对值并检查溢出
+  quint64 value = 0;
+  bool overflow = false;
+  if (*q == '0') {
+    q++;
+  } else {
+    for (; q < end && '0' <= *q && *q <= '9'; q++) {
+      int digit = *q - '0';
+      if (value > (std::numeric_limits<quint64>::max() - digit) / 10)
+        overflow = true;
+      value = value * 10 + digit;
+    }
+  }
+  bool integer = true;
+  if (q < end && *q == '.') {
+    integer = false;
+    if (++q >= end || *q < '0' || *q > '9') {
+      p[0] = q;
+      return false;
+    }
+    while (q < end && '0' <= *q && *q <= '9') q++;
+  }
+  if (q < end && (*q == 'e' || *q == 'E')) {
+    integer = false;
+    if (++q < end && (*q == '+' || *q == '-')) q++;
+    if (q >= end || *q < '0' || *q > '9') {
+      p[0] = q;
+      return false;
+    }
+    while (q < end && '0' <= *q && *q <= '9') q++;
+  }
+  int length = int(q - start);
+  if (integer && !overflow) {
+    // 与encode一致，LLONG_MAX及以上按大整数编码
+    if (!negative && value < quint64(MAX_SIGNED_LONGLONG)) {
+      encode_integer(buf, qlonglong(value));
+      p[0] = q;
+      return true;
+    }
+    if (negative && value <= quint64(MAX_SIGNED_LONGLONG) + 1) {
+      encode_integer(buf, qlonglong(0 - value));
+      p[0] = q;
+      return true;
+    }
+  }
+  if (integer && length < MAX_INT_LENGTH) {
+    QByteArray digits(start, length);
+    encode_big_number(buf, digits);
+  } else if (options.floatBits == 32 || options.floatBits == 64) {
+    double d = QByteArray::fromRawData(start, length).toDouble();
+    if (options.floatBits == 32)
+      encode_float32(buf, d);
+    else
+      encode_float64(buf, d);
+  } else {
+    return false;
+  }
+  p[0] = q;
+  return true;
+}
+
+bool QtRencode::json_value(const char **p, const char *end,
+                           QtRencodeBuffer *buf, const Options &options) {
+  // 用显式栈代替递归，记录每层容器类型码的位置和元素个数；
+  // 容器结束时元素较少则把类型码改写为定长类型码，否则追加CHR_TERM
+  struct Frame {
+    int header;
+    int count;
+    bool dict;
+  };
+  QVarLengthArray<Frame, 32> stack;
+  QByteArray scratch;
+  const char *q = skip_space(p[0], end);
+  bool ok = true;
+  while (ok) {
+    // 读一个值，容器只写入类型码后入栈
+    bool value = true;
+    if (q >= end) {
+      ok = false;
+    } else if (*q == '{' || *q == '[') {
+      Frame frame = {int(buf->size()), 0, *q == '{'};
+      buf->put(frame.dict ? CHR_DICT : CHR_LIST);
+      stack.append(frame);
+      q = skip_space(q + 1, end);
+      if (q >= end || *q != (frame.dict ? '}' : ']')) {
+        if (frame.dict) ok = json_key(&q, end, buf, &scratch);
+        continue;
+      }
+      value = false;
+    } else if (*q == '"') {
+      ok = json_string(&q, end, buf, &scratch);
+    } else if (*q == 't' || *q == 'f' || *q == 'n') {
+      ok = json_literal(&q, end, buf);
+    } else {
+      ok = json_number(&q, end, buf, options);
+    }
+    // 处理值之后的逗号和容器结束符
+    while (ok) {
+      if (stack.isEmpty()) {
+        p[0] = q;
+        return true;
+      }
+      Frame &top = stack.last();
+      if (value) top.count++;
+      value = true;
+      q = skip_space(q, end);
+      if (q < end && *q == ',' && top.count > 0) {
+        q = skip_space(q + 1, end);
+        if (top.dict) ok = json_key(&q, end, buf, &scratch);
+        break;
+      }
+      if (q >= end || *q != (top.dict ? '}' : ']')) {
+        ok = false;
+        break;
+      }
+      q++;
+      if (top.dict && top.count < DICT_FIXED_COUNT)
+        buf->set(top.header, DICT_FIXED_START + top.count);
+      else if (!top.dict && top.count < LIST_FIXED_COUNT)
+        buf->set(top.header, LIST_FIXED_START + top.count);
+      else
+        buf->put(CHR_TERM);
+      stack.removeLast();
+    }
+  }
+  p[0] = q;
+  return false;
+}
+
+/**
+ * @brief The QtRencodeJsonWriter class
+ * 把parse的事件直接写成紧凑的json文本。字典中非字符串的键写成带引号的文本，
+ * 容器不能作为键；NaN和无穷写成null
+ */
+class QtRencodeJsonWriter : public QtRencodeVisitor {
+ public:
+  explicit QtRencodeJsonWriter(int capacity)
+      : m_buf(capacity), m_error(false) {}
+
+  bool onNone() override { return scalar("null", 4); }
+  bool onBool(bool value) override {
+    return value ? scalar("true", 4) : scalar("false", 5);
+  }
+  bool onInt(qint64 value) override {
+    char tmp[24];
+    int size = qsnprintf(tmp, sizeof(tmp), "%lld", (long long)value);
+    return scalar(tmp, size);
+  }
+  bool onFloat(double value) override {
+    if (!qIsFinite(value)) return scalar("null", 4);
+    QByteArray tmp = format_float(value);
+    return scalar(tmp.constData(), tmp.size());
+  }
+  bool onString(const QByteArray &value) override {
+    separator();
+    string(value);
+    return true;
+  }
+  bool beginList(int) override { return begin('[', false); }
+  bool endList() override { return end(']'); }
+  bool beginDict(int) override { return begin('{', true); }
+  bool key(const QByteArray &key) override { return onString(key); }
+  bool endDict() override { return end('}'); }
+
+  bool hasError() const {
+    return m_error || m_buf.failure() != QtRencode::NoError;
+  }
+  QByteArray take() { return m_buf.take(); }
+
+ private:
+  // 当前位置是否为字典的键
+  bool at_key() const {
+    return !m_stack.isEmpty() && m_stack.last() >= 0 &&
+           m_stack.last() % 2 == 0;
+  }
+  // 写入元素之间的','或键值之间的':'，并计数
+  void separator() {
+    if (m_stack.isEmpty()) return;
+    int &count = m_stack.last();
+    if (count < 0) {
+      // 列表的计数为负数
+      if (count < -1) m_buf.put(',');
+      count--;
+    } else {
+      if (count > 0) m_buf.put(count % 2 == 0 ? ',' : ':');
+      count++;
+    }
+  }
+  bool scalar(const char *text, int size) {
+    bool quote = at_key();
+    separator();
+    if (quote) m_buf.put('"');
+    m_buf.write(text, size);
+    if (quote) m_buf.put('"');
+    return true;
+  }
+  bool begin(char c, bool dict) {
+    if (at_key()) {
+      m_error = true;
+      return false;
+    }
+    separator();
+    m_buf.put(c);
+    m_stack.append(dict ? 0 : -1);
+    return true;
+  }
+  bool end(char c) {
+    m_stack.removeLast();
+    m_buf.put(c);
+    return true;
+  }
+  void string(const QByteArray &value) {
+    static const char HEX[] = "0123456789abcdef";
+    const char *p = value.constData();
+    const char *end = p + value.size();
+    m_buf.put('"');
+    while (p < end) {
+      // 不需要转义的字节整段复制，UTF-8字节原样输出
+      const char *run = p;
+      while (p < end && *p != '"' && *p != '\\' && (quint8)*p >= 0x20) p++;
+      m_buf.write(run, int(p - run));
+      if (p >= end) break;
+      char c = *p++;
+      char escaped[6] = {'\\', c, 0, 0, 0, 0};
+      int size = 2;
+      switch (c) {
+        case '"':
+        case '\\':
+          break;
+        case '\b':
+          escaped[1] = 'b';
+          break;
+        case '\f':
+          escaped[1] = 'f';
+          break;
+        case '\n':
+          escaped[1] = 'n';
+          break;
+        case '\r':
+          escaped[1] = 'r';
+          break;
+        case '\t':
+          escaped[1] = 't';
+          break;
+        default:
+          escaped[1] = 'u';
+          escaped[2] = '0';
+          escaped[3] = '0';
+          escaped[4] = HEX[(quint8)c >> 4];
+          escaped[5] = HEX[c & 0xF];
+          size = 6;
+      }
+      m_buf.write(escaped, size);
+    }
+    m_buf.put('"');
+  }
+  // 能被float精确表示的值（通常来自CHR_FLOAT32）按float的最短形式输出，
+  // 避免667.2被写成667.2000122070312
+  static QByteArray format_float(double value) {
+    float f = float(value);
+    if (double(f) == value) {
+      for (int precision = 1; precision < 9; precision++) {
+        QByteArray tmp = QByteArray::number(value, 'g', precision);
+        if (tmp.toFloat() == f) return tmp;
+      }
+      return QByteArray::number(value, 'g', 9);
+    }
+    return QByteArray::number(value, 'g', QLocale::FloatingPointShortest);
+  }
+
+  QtRencodeBuffer m_buf;
+  // 每层容器已写入的元素个数，字典为非负数，列表为-1减去个数
+  QVector<int> m_stack;
+  bool m_error;
+};
+
+/**
+ * @brief QtRencode::toJson
+ * @param data
+ * @return QByteArray
+ * 把rencode数据直接转成紧凑的json文本，不构造QVariant，出错或输出超过
+ * QtRencodeBuffer::MAX_SIZE时返回空
+ */
+QByteArray QtRencode::toJson(const QByteArray &data) {
+  // 预估为输入的两倍，按qint64计算以免溢出
+  QtRencodeJsonWriter writer(int(
+      qMin(qint64(data.size()) * 2, qint64(QtRencodeBuffer::MAX_SIZE))));
+  unsigned int pos = 0;
+  if (!parse(data, &writer, &pos) || writer.hasError() ||
+      pos != (unsigned int)data.size())
+    return QByteArray();
+  return writer.take();
 }
 
 void dumps(QByteArray &out, const QVariant &data, int bits) {
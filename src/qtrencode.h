@@ -6,21 +6,180 @@
 #include <QByteArray>
 #include <QDataStream>
 #include <QDebug>
+#include <QIODevice>
 #include <QJsonDocument>
-#include <QSysInfo>
 #include <QTextCodec>
 #include <QVariant>
+#include <QVector>
 #include <QtEndian>
 
-static int FLOAT_BITS = 32;  // 32 or 64
-static bool USE_JSON = true;
+#include <vector>
 
+class QtRencodeKeyCache;
+class QtRencodeSegments;
+
+/**
+ * @brief The QtRencodeBuffer class
+ * 编码输出缓冲区，容量按两倍增长，结果以QByteArray直接取出。
+ * 指定QIODevice时缓冲区大小固定，写满后整块写入设备；
+ * 指定外部内存时不再分配，写满后只计数，hasError()为true
+ */
+class QtRencodeBuffer {
+ public:
+  // 最大容量，为QByteArray的头部和结尾的'\0'留出空间
+  static const int MAX_SIZE = INT_MAX - 32;
+
+  explicit QtRencodeBuffer(int capacity = 0);
+  QtRencodeBuffer(QIODevice *device, int capacity);
+  QtRencodeBuffer(char *data, int capacity);
+
+  inline void put(char c) {
+    if (Q_UNLIKELY(m_pos >= m_capacity)) {
+      write_slow(&c, 1);
+      return;
+    }
+    m_data[m_pos++] = c;
+  }
+  inline void write(const void *data, int size) {
+    if (Q_UNLIKELY(size > m_capacity - m_pos)) {
+      write_slow(data, size);
+      return;
+    }
+    memcpy(m_data + m_pos, data, size);
+    m_pos += size;
+  }
+  // 已编码的总字节数
+  inline qint64 size() const { return m_written + m_pos; }
+  // 已写入设备的字节数
+  inline qint64 flushedSize() const { return m_written; }
+  // 改写已写入的一个字节，只用于未绑定设备的缓冲区
+  inline void set(int pos, char c) { m_data[pos] = c; }
+
+  void reserve(int capacity);
+  // 编码结果超过maxSize字节时记录OutputTooLarge，不超过MAX_SIZE
+  void setMaxSize(qint64 maxSize);
+  QByteArray take();
+  bool flush();
+  bool truncate(qint64 size);
+  bool hasError() const { return m_error; }
+  // 记录第一个编码错误（QtRencode::Error）及其所在的输出位置
+  void fail(int error);
+  int failure() const { return m_failure; }
+  qint64 failureOffset() const { return m_failureOffset; }
+  void clearFailure();
+
+  // 分段输出：不短于threshold的字节串只记录引用，不复制到缓冲区
+  void setSegments(QtRencodeSegments *segments, int threshold);
+  inline bool canReference(int size) const {
+    return m_segments != NULL && size >= m_threshold;
+  }
+  void reference(const QByteArray &data);
+  void finishSegments();
+
+ private:
+  Q_DISABLE_COPY(QtRencodeBuffer)
+  bool grow(int size);
+  void write_slow(const void *data, int size);
+
+  static const int MIN_CAPACITY = 64;
+
+  QByteArray m_buffer;
+  char *m_data;
+  int m_pos;
+  int m_capacity;
+  QIODevice *m_device;
+  // 使用外部内存
+  bool m_fixed;
+  // 已写入设备的字节数，或外部内存写满后未写入的字节数
+  qint64 m_written;
+  bool m_error;
+  int m_failure;
+  qint64 m_failureOffset;
+  qint64 m_maxSize;
+  QtRencodeSegments *m_segments;
+  int m_threshold;
+  // 尚未加入分段的头部字节的起点
+  int m_mark;
+};
+
+/**
+ * @brief The QtRencodeSegments class
+ * 分段编码的结果，适合用writev一次写出。类型码、长度等头部字节连续存放，
+ * 较长的字节串只引用原数据（隐式共享，保证在本对象存在期间有效），
+ * 依次拼接各段即得到与dumps相同的数据
+ */
+class QtRencodeSegments {
+ public:
+  int count() const { return m_pieces.size(); }
+  const char *data(int i) const;
+  int size(int i) const { return m_pieces.at(i).size; }
+  qint64 totalSize() const;
+  QByteArray join() const;
+  void clear();
+
+ private:
+  friend class QtRencodeBuffer;
+
+  struct Piece {
+    // 头部字节在m_headers中的偏移，引用的字节串为-1
+    int offset;
+    int size;
+    // 引用的字节串在m_blobs中的下标
+    int blob;
+  };
+  void add_header(int offset, int size);
+  void add_blob(const QByteArray &data);
+
+  QByteArray m_headers;
+  QVector<Piece> m_pieces;
+  QList<QByteArray> m_blobs;
+};
+
+/**
+ * @brief The QtRencodeVisitor class
+ * 事件式解码的回调接口，QtRencode::parse按数据顺序调用各回调而不构造QVariant。
+ * 回调返回false时立即停止解析。字典中字符串类型的键通过key()传入，
+ * 其它类型的键按普通值回调；onString和key收到的字节串直接引用输入数据，
+ * 只在回调期间有效。列表或字典长度未知时size为-1
+ */
+class QtRencodeVisitor {
+ public:
+  virtual ~QtRencodeVisitor() {}
+
+  virtual bool onNone() { return true; }
+  virtual bool onBool(bool /*value*/) { return true; }
+  virtual bool onInt(qint64 /*value*/) { return true; }
+  virtual bool onFloat(double /*value*/) { return true; }
+  virtual bool onString(const QByteArray &/*value*/) { return true; }
+  virtual bool beginList(int /*size*/) { return true; }
+  virtual bool endList() { return true; }
+  virtual bool beginDict(int /*size*/) { return true; }
+  virtual bool key(const QByteArray &/*key*/) { return true; }
+  virtual bool endDict() { return true; }
+};
+
+/**
+ * @brief The QtRencode class
+ * 编解码过程不读写任何全局状态，所有选项都通过Options按调用传递，
+ * 因此可以在多个线程中同时调用dumps/loads
+ */
 class QtRencode : public QObject {
   Q_OBJECT
+  friend class QtRencodeStreamDecoder;
+  friend class QtRencodeStreamEncoder;
+  friend class QtRencodeDocument;
+  friend class QtRencodeMappedFile;
+  friend class QtRencodeParallel;
 
   // Default number of bits for serialized floats, either 32 or 64 (also a
   // parameter for dumps()).
   static const quint8 DEFAULT_FLOAT_BITS = 32;
+  // 写入QIODevice时默认的缓冲区大小
+  static const int DEFAULT_CHUNK_SIZE = 64 * 1024;
+  // 分段编码时不复制的字节串的最小长度
+  static const int DEFAULT_SEGMENT_THRESHOLD = 4096;
+  // 默认的最大嵌套层数
+  static const int DEFAULT_MAX_DEPTH = 512;
   // Maximum length of integer when written as base 10 string.
   static const quint8 MAX_INT_LENGTH = 64;
   // The bencode 'typecodes' such as i, d, etc have been extended and relocated
@@ -59,64 +218,339 @@ class QtRencode : public QObject {
   static const qlonglong MAX_SIGNED_LONGLONG = LLONG_MAX;
   static const qlonglong MIN_SIGNED_LONGLONG = LLONG_MIN;
 
-  static const bool BIG_ENDIAN = QSysInfo::ByteOrder == QSysInfo::BigEndian;
-
  public:
+  /**
+   * @brief The Options struct
+   * 单次编解码调用的选项
+   */
+  struct Options {
+    // 编码浮点数的位数，32或64
+    int floatBits;
+    // 解码时字符串转为QString，字典转为QVariantMap
+    bool useJson;
+    // useJson为false时，解码出的字节串用QByteArray::fromRawData直接引用输入
+    // 数据而不复制。调用者须保证输入数据在结果使用期间一直存在且不被修改，
+    // 引用的字节串不以'\0'结尾，需要独立副本时对其调用detach()
+    bool zeroCopy;
+    // useJson为true时字典键的驻留缓存，为NULL时不使用；由调用者创建，
+    // 须在解码期间一直存在，多个线程（含QtRencodeParallel）同时使用时
+    // 须以threadSafe方式创建
+    QtRencodeKeyCache *keyCache;
+    // 编码结果的最大字节数，超过时报告OutputTooLarge
+    qint64 maxOutputSize;
+
+    Options()
+        : floatBits(DEFAULT_FLOAT_BITS),
+          useJson(true),
+          zeroCopy(false),
+          keyCache(NULL),
+          maxOutputSize(QtRencodeBuffer::MAX_SIZE) {}
+  };
+
+  /**
+   * @brief The Error enum
+   * 解码失败的原因
+   */
+  enum Error {
+    NoError,
+    // 数据在一个值的中间结束
+    TruncatedData,
+    // 不是任何值开头的类型码，包括多余的CHR_TERM
+    InvalidTypecode,
+    // 长字符串的长度前缀或大整数格式错误，validate时还包括值之后多余的数据
+    MalformedData,
+    DepthLimitExceeded,
+    StringLimitExceeded,
+    ContainerLimitExceeded,
+    NodeLimitExceeded,
+    // 编码时遇到无法表示的QVariant类型
+    UnsupportedType,
+    // 编码时整数超过MAX_INT_LENGTH位
+    NumberTooLong,
+    // Options中的floatBits不是32或64
+    InvalidOption,
+    // 编码结果超过Options::maxOutputSize或QByteArray的最大长度
+    OutputTooLarge
+  };
+
+  /**
+   * @brief The Result struct
+   * 编解码的结果，成功时只是三个整数的赋值，失败时也不格式化任何字符串
+   */
+  struct Result {
+    Error error;
+    // 出错的位置：解码时为输入数据中的偏移，编码时为已输出的字节数
+    qint64 offset;
+    // 出错位置的类型码，数据已结束或编码出错时为0
+    quint8 typecode;
+
+    Result() : error(NoError), offset(-1), typecode(0) {}
+    bool ok() const { return error == NoError; }
+  };
+
+  /**
+   * @brief The Limits struct
+   * 处理不可信数据时的上限，默认只限制嵌套层数
+   */
+  struct Limits {
+    // 列表、字典的最大嵌套层数
+    int maxDepth;
+    // 字符串的最大字节数
+    int maxStringLength;
+    // 列表的最大元素个数、字典的最大键值对个数
+    int maxContainerSize;
+    // 值（含容器本身、字典的键）的最大总个数
+    qint64 maxNodes;
+
+    Limits()
+        : maxDepth(DEFAULT_MAX_DEPTH),
+          maxStringLength(INT_MAX),
+          maxContainerSize(INT_MAX),
+          maxNodes(LLONG_MAX) {}
+  };
+
+  /**
+   * 跟踪回调：function为编解码函数名，typecode为类型码，offset为该值在数据
+   * 中的偏移，length为负载长度（数值字节数、字符串字节数或容器元素个数）
+   */
+  typedef void (*TraceHandler)(const char *function, quint8 typecode,
+                               quint32 offset, quint32 length);
+
   static QByteArray dumps(const QByteArray &data, int bits = 32);
-  static QByteArray dumps(const QJsonDocument &data, int bits = 32);
-  static QByteArray dumps(const QVariant &data, int bits = 32);
+  static QByteArray dumps(const QJsonDocument &data, int bits = 32,
+                          int capacity = 0);
+  static QByteArray dumps(const QVariant &data, int bits = 32,
+                          int capacity = 0);
   static QVariant loads(const QByteArray &data, bool json = true);
 
+  static QByteArray dumps(const QByteArray &data, const Options &options);
+  static QByteArray dumps(const QJsonDocument &data, const Options &options,
+                          int capacity = 0);
+  static QByteArray dumps(const QVariant &data, const Options &options,
+                          int capacity = 0);
+  static QVariant loads(const QByteArray &data, const Options &options);
+  static Result dumps(const QVariant &data, QByteArray *out,
+                      const Options &options = Options());
+  static Result loads(const QByteArray &data, QVariant *value,
+                      const Options &options = Options(),
+                      const Limits &limits = Limits());
+  static Result encodeBatch(const QVariant *values, int count, QByteArray *out,
+                            QVector<int> *offsets,
+                            const Options &options = Options(),
+                            int capacity = 0);
+  static Result encodeBatch(const QVariantList &values, QByteArray *out,
+                            QVector<int> *offsets,
+                            const Options &options = Options(),
+                            int capacity = 0);
+  static Result decodeBatch(const QByteArray &data, QVariantList *values,
+                            QVector<int> *offsets = NULL,
+                            const Options &options = Options(),
+                            const Limits &limits = Limits());
+  static bool dump(QIODevice *device, const QVariant &data,
+                   const Options &options = Options(),
+                   int chunkSize = DEFAULT_CHUNK_SIZE);
+  static qint64 encodedSize(const QVariant &data,
+                            const Options &options = Options());
+  static qint64 encodeInto(char *out, size_t capacity, const QVariant &data,
+                           const Options &options = Options());
+  static qint64 encodeSegments(const QVariant &data,
+                               QtRencodeSegments *segments,
+                               const Options &options = Options(),
+                               int threshold = DEFAULT_SEGMENT_THRESHOLD);
+
+  static QByteArray dumps(const QVector<qint32> &data);
+  static QByteArray dumps(const QVector<qint64> &data);
+  static QByteArray dumps(const QVector<float> &data);
+  static QByteArray dumps(const QVector<double> &data);
+  static QByteArray dumps(const std::vector<qint32> &data);
+  static QByteArray dumps(const std::vector<qint64> &data);
+  static QByteArray dumps(const std::vector<float> &data);
+  static QByteArray dumps(const std::vector<double> &data);
+  static bool loads(const QByteArray &data, QVector<qint32> *out);
+  static bool loads(const QByteArray &data, QVector<qint64> *out);
+  static bool loads(const QByteArray &data, QVector<float> *out);
+  static bool loads(const QByteArray &data, QVector<double> *out);
+  static bool loads(const QByteArray &data, std::vector<qint32> *out);
+  static bool loads(const QByteArray &data, std::vector<qint64> *out);
+  static bool loads(const QByteArray &data, std::vector<float> *out);
+  static bool loads(const QByteArray &data, std::vector<double> *out);
+
+  static bool parse(const QByteArray &data, QtRencodeVisitor *visitor,
+                    unsigned int *pos = NULL,
+                    int maxDepth = DEFAULT_MAX_DEPTH);
+  static qint64 skipValue(const QByteArray &data, qint64 pos = 0,
+                          Result *result = NULL);
+  static Result validate(const QByteArray &data,
+                         const Limits &limits = Limits());
+
+  static QByteArray fromJson(const QByteArray &json,
+                             const Options &options = Options(),
+                             int *errorOffset = NULL);
+  static QByteArray toJson(const QByteArray &data);
+
+  static void setTraceHandler(TraceHandler handler);
+  static void debugTraceHandler(const char *function, quint8 typecode,
+                                quint32 offset, quint32 length);
+
  private:
-  static void swap_byte_order_ushort(unsigned short *s);
-  static short swap_byte_order_short(char *c);
-  static void swap_byte_order_uint(int *i);
-  static int swap_byte_order_int(char *c);
-  static void swap_byte_order_ulong_long(long long *l);
-  static long long swap_byte_order_long_long(char *c);
-  static float swap_byte_order_float(char *c);
-  static double swap_byte_order_double(char *c);
-
-  static void write_buffer_char(char **buf, unsigned int *pos, char c);
-  static void write_buffer(char **buf, unsigned int *pos, void *data, int size);
   static bool check_pos(const QByteArray &data, unsigned int pos);
+  static int big_number_length(const QByteArray &data, unsigned int pos);
+  static bool read_str_header(const QByteArray &data, unsigned int pos,
+                              int *size, int *digits);
+  static qint64 token_length(const char *data, qint64 size, qint64 pos);
+  static qint64 skip_value(const char *data, qint64 size, qint64 pos,
+                           const Limits *limits = NULL,
+                           Result *result = NULL);
+
+  // 类型码的分类
+  enum Kind {
+    KIND_INVALID,
+    KIND_FIXED_POS_INT,
+    KIND_FIXED_NEG_INT,
+    KIND_INT1,
+    KIND_INT2,
+    KIND_INT4,
+    KIND_INT8,
+    KIND_BIG_NUMBER,
+    KIND_FLOAT32,
+    KIND_FLOAT64,
+    KIND_FIXED_STR,
+    KIND_STR,
+    KIND_NONE,
+    KIND_TRUE,
+    KIND_FALSE,
+    KIND_FIXED_LIST,
+    KIND_LIST,
+    KIND_FIXED_DICT,
+    KIND_DICT
+  };
+  // 一次解码的状态，出错后各层解码函数不再读取数据，立即返回
+  struct DecodeContext {
+    const Options &options;
+    const Limits &limits;
+    int depth;
+    qint64 nodes;
+    Error error;
+    unsigned int errorOffset;
+    // 不含BOM的字符串所用的编码，首次用到时查找，之后在整个批次中复用
+    QTextCodec *codec;
+  };
+  typedef QVariant (*Decoder)(const QByteArray &data, unsigned int *pos,
+                              DecodeContext *ctx);
+  struct TypeInfo {
+    quint8 kind;
+    // 类型码之后的定长负载字节数（定长数值、定长字符串）
+    quint8 size;
+    // 嵌在类型码中的整数值，或定长列表、字典的元素个数
+    qint8 embedded;
+    Decoder decoder;
+  };
+  // 以类型码为下标的分派表
+  static const TypeInfo TYPE_TABLE[256];
+  static constexpr TypeInfo type_info(int c);
+
+  enum ParseState { PARSE_ERROR, PARSE_STOP, PARSE_CONTINUE };
+  static ParseState parse_value(const QByteArray &data, unsigned int *pos,
+                                QtRencodeVisitor *visitor, int depth);
+
+  static bool json_string(const char **p, const char *end,
+                          QtRencodeBuffer *buf, QByteArray *scratch);
+  static bool json_key(const char **p, const char *end, QtRencodeBuffer *buf,
+                       QByteArray *scratch);
+  static bool json_literal(const char **p, const char *end,
+                           QtRencodeBuffer *buf);
+  static bool json_number(const char **p, const char *end,
+                          QtRencodeBuffer *buf, const Options &options);
+  static bool json_value(const char **p, const char *end, QtRencodeBuffer *buf,
+                         const Options &options);
+
+  static void encode_char(QtRencodeBuffer *buf, signed char x);
+  static void encode_short(QtRencodeBuffer *buf, short x);
+  static void encode_int(QtRencodeBuffer *buf, int x);
+  static void encode_long_long(QtRencodeBuffer *buf, long long x);
+  static void encode_integer(QtRencodeBuffer *buf, qlonglong x);
+  static void encode_big_number(QtRencodeBuffer *buf, QByteArray &x);
+  static void encode_float32(QtRencodeBuffer *buf, float x);
+  static void encode_float64(QtRencodeBuffer *buf, double x);
+  static void encode_str_header(QtRencodeBuffer *buf, int size);
+  static void encode_str(QtRencodeBuffer *buf, QByteArray x);
+  static void encode_str(QtRencodeBuffer *buf, const char *data, int size);
+  static void encode_none(QtRencodeBuffer *buf);
+  static void encode_bool(QtRencodeBuffer *buf, bool x);
+  static void encode_number(QtRencodeBuffer *buf, qint32 x);
+  static void encode_number(QtRencodeBuffer *buf, qint64 x);
+  static void encode_number(QtRencodeBuffer *buf, float x);
+  static void encode_number(QtRencodeBuffer *buf, double x);
+  template <typename T>
+  static QByteArray encode_array(const T *data, int size);
+  template <typename Container>
+  static bool decode_array(const QByteArray &data, Container *out);
+  template <typename Iterator>
+  static Result encode_batch(Iterator values, int count, QByteArray *out,
+                             QVector<int> *offsets, const Options &options,
+                             int capacity);
+  static void encode_list(QtRencodeBuffer *buf, const QVariantList &x,
+                          const Options &options);
+  static void encode_dict(QtRencodeBuffer *buf, const QVariant &x,
+                          const Options &options);
+  static void encode_dict(QtRencodeBuffer *buf, const QVariantMap &x,
+                          const Options &options);
+  static void encode_dict(QtRencodeBuffer *buf,
+                          const QMap<QVariant, QVariant> &x,
+                          const Options &options);
+  static void encode(QtRencodeBuffer *buf, const QVariant &data,
+                     const Options &options);
 
-  static void encode_char(char **buf, unsigned int *pos, signed char x);
-  static void encode_short(char **buf, unsigned int *pos, short x);
-  static void encode_int(char **buf, unsigned int *pos, int x);
-  static void encode_long_long(char **buf, unsigned int *pos, long long x);
-  static void encode_big_number(char **buf, unsigned int *pos, QByteArray &x);
-  static void encode_float32(char **buf, unsigned int *pos, float x);
-  static void encode_float64(char **buf, unsigned int *pos, double x);
-  static void encode_str(char **buf, unsigned int *pos, QByteArray x);
-  static void encode_none(char **buf, unsigned int *pos);
-  static void encode_bool(char **buf, unsigned int *pos, bool x);
-  static void encode_list(char **buf, unsigned int *pos, const QVariantList &x);
-  static void encode_dict(char **buf, unsigned int *pos, const QVariant &x);
-  static void encode_dict(char **buf, unsigned int *pos, const QVariantMap &x);
-  static void encode_dict(char **buf, unsigned int *pos,
-                          const QMap<QVariant, QVariant> &x);
-  static void encode(char **buf, unsigned int *pos, const QVariant &data);
-
-  static QVariant decode_char(const QByteArray &data, unsigned int *pos);
-  static QVariant decode_short(const QByteArray &data, unsigned int *pos);
-  static QVariant decode_int(const QByteArray &data, unsigned int *pos);
-  static QVariant decode_long_long(const QByteArray &data, unsigned int *pos);
+  static QVariant decode_char(const QByteArray &data, unsigned int *pos,
+                              DecodeContext *ctx);
+  static QVariant decode_short(const QByteArray &data, unsigned int *pos,
+                               DecodeContext *ctx);
+  static QVariant decode_int(const QByteArray &data, unsigned int *pos,
+                             DecodeContext *ctx);
+  static QVariant decode_long_long(const QByteArray &data, unsigned int *pos,
+                                   DecodeContext *ctx);
   static QVariant decode_fixed_pos_int(const QByteArray &data,
-                                       unsigned int *pos);
+                                       unsigned int *pos, DecodeContext *ctx);
   static QVariant decode_fixed_neg_int(const QByteArray &data,
-                                       unsigned int *pos);
-  static QVariant decode_big_number(const QByteArray &data, unsigned int *pos);
-  static QVariant decode_float32(const QByteArray &data, unsigned int *pos);
-  static QVariant decode_float64(const QByteArray &data, unsigned int *pos);
-  static QVariant decode_fixed_str(const QByteArray &data, unsigned int *pos);
-  static QVariant decode_str(const QByteArray &data, unsigned int *pos);
-  static QVariantList decode_fixed_list(const QByteArray &data,
-                                        unsigned int *pos);
-  static QVariantList decode_list(const QByteArray &data, unsigned int *pos);
-  static QVariant decode_fixed_dict(const QByteArray &data, unsigned int *pos);
-  static QVariant decode_dict(const QByteArray &data, unsigned int *pos);
-  static QVariant decode(const QByteArray &data, unsigned int *pos);
+                                       unsigned int *pos, DecodeContext *ctx);
+  static QVariant decode_big_number(const QByteArray &data, unsigned int *pos,
+                                    DecodeContext *ctx);
+  static QVariant decode_float32(const QByteArray &data, unsigned int *pos,
+                                 DecodeContext *ctx);
+  static QVariant decode_float64(const QByteArray &data, unsigned int *pos,
+                                 DecodeContext *ctx);
+  static QString decode_text(DecodeContext *ctx, const QByteArray &s);
+  static QVariant decode_bytes(const QByteArray &data, unsigned int offset,
+                               int size, DecodeContext *ctx);
+  static QVariant decode_fixed_str(const QByteArray &data, unsigned int *pos,
+                                   DecodeContext *ctx);
+  static QVariant decode_str(const QByteArray &data, unsigned int *pos,
+                             DecodeContext *ctx);
+  static QVariant decode_fixed_list(const QByteArray &data, unsigned int *pos,
+                                    DecodeContext *ctx);
+  static QVariant decode_list(const QByteArray &data, unsigned int *pos,
+                              DecodeContext *ctx);
+  static bool cached_key(const QByteArray &data, unsigned int *pos,
+                         DecodeContext *ctx, QString *key, QByteArray *raw);
+  static void decode_pair(const QByteArray &data, unsigned int *pos,
+                          DecodeContext *ctx, QVariantMap *json,
+                          QMap<QVariant, QVariant> *map);
+  static QVariant decode_fixed_dict(const QByteArray &data, unsigned int *pos,
+                                    DecodeContext *ctx);
+  static QVariant decode_dict(const QByteArray &data, unsigned int *pos,
+                              DecodeContext *ctx);
+  static QVariant decode_none(const QByteArray &data, unsigned int *pos,
+                              DecodeContext *ctx);
+  static QVariant decode_bool(const QByteArray &data, unsigned int *pos,
+                              DecodeContext *ctx);
+  static QVariant decode_invalid(const QByteArray &data, unsigned int *pos,
+                                 DecodeContext *ctx);
+  static QVariant decode_error(DecodeContext *ctx, Error error,
+                               unsigned int pos);
+  static QVariant decode(const QByteArray &data, unsigned int *pos,
+                         DecodeContext *ctx);
+  static QVariant decode(const QByteArray &data, unsigned int *pos,
+                         const Options &options);
 };
 
 extern "C" {
@@ -0,0 +1,183 @@
+﻿#include "qtrencodebyteorder.h"
+
+#include <QtEndian>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QTRENCODE_X86
+#define QTRENCODE_TARGET(feature) __attribute__((target(feature)))
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define QTRENCODE_X86
+#define QTRENCODE_TARGET(feature)
+#include <immintrin.h>
+#include <intrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define QTRENCODE_NEON
+#include <arm_neon.h>
+#endif
+
+// 向量实现处理bytes中按向量宽度对齐的前一部分，返回已处理的字节数，
+// 剩余部分由标量实现完成
+typedef int (*Kernel)(const char *src, char *dst, int bytes);
+
+struct Kernels {
+  Kernel swap16;
+  Kernel swap32;
+  Kernel swap64;
+  const char *name;
+};
+
+template <typename T>
+static void swap_scalar(const char *src, char *dst, int count) {
+  for (int i = 0; i < count; i++) {
+    T v;
+    memcpy(&v, src + i * sizeof(T), sizeof(T));
+    v = qbswap(v);
+    memcpy(dst + i * sizeof(T), &v, sizeof(T));
+  }
+}
+
+#ifdef QTRENCODE_X86
+// pshufb的字节重排表，依次为16、32、64位
+static const char SHUFFLE[3][16] = {
+    {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+    {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+    {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8}};
+
+template <int N>
+QTRENCODE_TARGET("sse2")
+static __m128i bswap_sse2(__m128i v) {
+  // 先交换16位内的两个字节，再重排16位的字
+  v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+  if (N == 4) {
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+  } else if (N == 8) {
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  }
+  return v;
+}
+
+template <int N>
+QTRENCODE_TARGET("sse2")
+static int swap_sse2(const char *src, char *dst, int bytes) {
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_si128((__m128i *)(dst + i), bswap_sse2<N>(v));
+  }
+  return i;
+}
+
+template <int N>
+QTRENCODE_TARGET("ssse3")
+static int swap_ssse3(const char *src, char *dst, int bytes) {
+  const __m128i mask =
+      _mm_loadu_si128((const __m128i *)SHUFFLE[N == 2 ? 0 : N == 4 ? 1 : 2]);
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(v, mask));
+  }
+  return i;
+}
+
+template <int N>
+QTRENCODE_TARGET("avx2")
+static int swap_avx2(const char *src, char *dst, int bytes) {
+  // vpshufb在两个128位通道内分别重排，重排表复制到两个通道
+  const __m256i mask = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128((const __m128i *)SHUFFLE[N == 2 ? 0 : N == 4 ? 1 : 2]));
+  int i = 0;
+  for (; i + 32 <= bytes; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(v, mask));
+  }
+  return i + swap_ssse3<N>(src + i, dst + i, bytes - i);
+}
+
+static Kernels select_kernels() {
+  bool ssse3 = false;
+  bool avx2 = false;
+#if defined(__GNUC__)
+  __builtin_cpu_init();
+  ssse3 = __builtin_cpu_supports("ssse3");
+  avx2 = __builtin_cpu_supports("avx2");
+#else
+  int info[4];
+  __cpuid(info, 1);
+  ssse3 = (info[2] & (1 << 9)) != 0;
+  // AVX2还需要操作系统保存YMM寄存器
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  __cpuidex(info, 7, 0);
+  avx2 = osxsave && (info[1] & (1 << 5)) != 0 && (_xgetbv(0) & 6) == 6;
+#endif
+  if (avx2)
+    return {&swap_avx2<2>, &swap_avx2<4>, &swap_avx2<8>, "avx2"};
+  if (ssse3)
+    return {&swap_ssse3<2>, &swap_ssse3<4>, &swap_ssse3<8>, "ssse3"};
+  return {&swap_sse2<2>, &swap_sse2<4>, &swap_sse2<8>, "sse2"};
+}
+#elif defined(QTRENCODE_NEON)
+static int swap_neon16(const char *src, char *dst, int bytes) {
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16)
+    vst1q_u8((uint8_t *)(dst + i),
+             vrev16q_u8(vld1q_u8((const uint8_t *)(src + i))));
+  return i;
+}
+
+static int swap_neon32(const char *src, char *dst, int bytes) {
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16)
+    vst1q_u8((uint8_t *)(dst + i),
+             vrev32q_u8(vld1q_u8((const uint8_t *)(src + i))));
+  return i;
+}
+
+static int swap_neon64(const char *src, char *dst, int bytes) {
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16)
+    vst1q_u8((uint8_t *)(dst + i),
+             vrev64q_u8(vld1q_u8((const uint8_t *)(src + i))));
+  return i;
+}
+
+static Kernels select_kernels() {
+  return {&swap_neon16, &swap_neon32, &swap_neon64, "neon"};
+}
+#else
+static int scalar_kernel(const char *, char *, int) { return 0; }
+
+static Kernels select_kernels() {
+  return {&scalar_kernel, &scalar_kernel, &scalar_kernel, "scalar"};
+}
+#endif
+
+static const Kernels &kernels() {
+  // 局部静态变量的初始化是线程安全的
+  static const Kernels k = select_kernels();
+  return k;
+}
+
+void QtRencodeByteOrder::swap16(const void *src, void *dst, int count) {
+  int done = kernels().swap16((const char *)src, (char *)dst, count * 2);
+  swap_scalar<quint16>((const char *)src + done, (char *)dst + done,
+                       count - done / 2);
+}
+
+void QtRencodeByteOrder::swap32(const void *src, void *dst, int count) {
+  int done = kernels().swap32((const char *)src, (char *)dst, count * 4);
+  swap_scalar<quint32>((const char *)src + done, (char *)dst + done,
+                       count - done / 4);
+}
+
+void QtRencodeByteOrder::swap64(const void *src, void *dst, int count) {
+  int done = kernels().swap64((const char *)src, (char *)dst, count * 8);
+  swap_scalar<quint64>((const char *)src + done, (char *)dst + done,
+                       count - done / 8);
+}
+
+const char *QtRencodeByteOrder::kernel() { return kernels().name; }
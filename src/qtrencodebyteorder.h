@@ -0,0 +1,52 @@
+﻿#ifndef QTRENCODEBYTEORDER_H
+#define QTRENCODEBYTEORDER_H
+
+#pragma once
+
+#include <QtGlobal>
+
+#include <string.h>
+
+/**
+ * @brief The QtRencodeByteOrder class
+ * 批量字节序转换。首次使用时按CPU特性选择AVX2、SSSE3、SSE2或NEON实现，
+ * 不支持时使用逐个值的标量实现。src和dst可以是同一块内存，但不能部分重叠
+ */
+class QtRencodeByteOrder {
+ public:
+  static void swap16(const void *src, void *dst, int count);
+  static void swap32(const void *src, void *dst, int count);
+  static void swap64(const void *src, void *dst, int count);
+
+  // 本机字节序与大端之间的转换，大端机器上只做复制
+  template <typename T>
+  static void toBigEndian(const T *src, T *dst, int count) {
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    if (src != dst) memcpy(dst, src, count * sizeof(T));
+#else
+    swap(src, dst, count, Width<sizeof(T)>());
+#endif
+  }
+  template <typename T>
+  static void fromBigEndian(const T *src, T *dst, int count) {
+    toBigEndian(src, dst, count);
+  }
+
+  // 当前使用的实现名称
+  static const char *kernel();
+
+ private:
+  template <int N>
+  struct Width {};
+  static void swap(const void *src, void *dst, int count, Width<2>) {
+    swap16(src, dst, count);
+  }
+  static void swap(const void *src, void *dst, int count, Width<4>) {
+    swap32(src, dst, count);
+  }
+  static void swap(const void *src, void *dst, int count, Width<8>) {
+    swap64(src, dst, count);
+  }
+};
+
+#endif  // QTRENCODEBYTEORDER_H
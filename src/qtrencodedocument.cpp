@@ -0,0 +1,198 @@
+﻿#include "qtrencodedocument.h"
+
+QtRencodeDocument::QtRencodeDocument() : m_offset(-1) {}
+
+QtRencodeDocument::QtRencodeDocument(const QByteArray &data)
+    : m_data(data), m_offset(data.isEmpty() ? -1 : 0) {
+  init_index();
+}
+
+QtRencodeDocument::QtRencodeDocument(const QByteArray &data, qint64 offset)
+    : m_data(data), m_offset(offset) {
+  init_index();
+}
+
+/**
+ * @brief QtRencodeDocument::init_index
+ * 容器在构造时就建立共享的偏移表，副本无论何时复制都共用同一张表
+ */
+void QtRencodeDocument::init_index() {
+  Type t = type();
+  if (t != List && t != Dict) return;
+  m_index = QSharedPointer<Index>::create();
+  m_index->next = m_offset + 1;
+  m_index->complete = false;
+  m_index->error = false;
+}
+
+QtRencodeDocument::Type QtRencodeDocument::type() const {
+  if (m_offset < 0 || m_offset >= m_data.size()) return Invalid;
+  switch (QtRencode::TYPE_TABLE[(quint8)m_data.at(m_offset)].kind) {
+    case QtRencode::KIND_FIXED_POS_INT:
+    case QtRencode::KIND_FIXED_NEG_INT:
+    case QtRencode::KIND_INT1:
+    case QtRencode::KIND_INT2:
+    case QtRencode::KIND_INT4:
+    case QtRencode::KIND_INT8:
+    case QtRencode::KIND_BIG_NUMBER:
+      return Int;
+    case QtRencode::KIND_FLOAT32:
+    case QtRencode::KIND_FLOAT64:
+      return Float;
+    case QtRencode::KIND_FIXED_STR:
+    case QtRencode::KIND_STR:
+      return String;
+    case QtRencode::KIND_NONE:
+      return None;
+    case QtRencode::KIND_TRUE:
+    case QtRencode::KIND_FALSE:
+      return Bool;
+    case QtRencode::KIND_FIXED_LIST:
+    case QtRencode::KIND_LIST:
+      return List;
+    case QtRencode::KIND_FIXED_DICT:
+    case QtRencode::KIND_DICT:
+      return Dict;
+    default:
+      return Invalid;
+  }
+}
+
+/**
+ * @brief QtRencodeDocument::size
+ * @return int
+ * 列表的元素个数、字典的键值对个数或字符串的字节数。
+ * 定长容器直接取类型码中的个数，以CHR_TERM结束的容器需要扫描到结尾
+ */
+int QtRencodeDocument::size() const {
+  Type t = type();
+  const QtRencode::TypeInfo &info =
+      QtRencode::TYPE_TABLE[t == Invalid ? 0 : (quint8)m_data.at(m_offset)];
+  if (t == String) return toBytes().size();
+  if (t != List && t != Dict) return 0;
+  if (info.kind == QtRencode::KIND_FIXED_LIST ||
+      info.kind == QtRencode::KIND_FIXED_DICT)
+    return info.embedded;
+  scan_to(INT_MAX);
+  int count = m_index->offsets.size();
+  return t == Dict ? count / 2 : count;
+}
+
+QtRencodeDocument QtRencodeDocument::at(int i) const {
+  return type() == List ? element(i) : QtRencodeDocument();
+}
+
+QtRencodeDocument QtRencodeDocument::keyAt(int i) const {
+  return type() == Dict && i >= 0 ? element(i * 2) : QtRencodeDocument();
+}
+
+QtRencodeDocument QtRencodeDocument::valueAt(int i) const {
+  return type() == Dict && i >= 0 ? element(i * 2 + 1) : QtRencodeDocument();
+}
+
+/**
+ * @brief QtRencodeDocument::value
+ * @param key
+ * @return QtRencodeDocument
+ * 字典中字符串键key对应的值，按顺序比较键的字节，不解码其它值
+ */
+QtRencodeDocument QtRencodeDocument::value(const QByteArray &key) const {
+  if (type() != Dict) return QtRencodeDocument();
+  for (int i = 0;; i += 2) {
+    QtRencodeDocument k = element(i);
+    if (!k.isValid()) return QtRencodeDocument();
+    if (k.type() == String && k.toBytes() == key) return element(i + 1);
+  }
+}
+
+bool QtRencodeDocument::toBool() const {
+  return type() == Bool &&
+         (quint8)m_data.at(m_offset) == QtRencode::CHR_TRUE;
+}
+
+qint64 QtRencodeDocument::toInt() const {
+  Type t = type();
+  return t == Int || t == Float ? toVariant().toLongLong() : 0;
+}
+
+double QtRencodeDocument::toDouble() const {
+  Type t = type();
+  return t == Int || t == Float ? toVariant().toDouble() : 0;
+}
+
+/**
+ * @brief QtRencodeDocument::toBytes
+ * @return QByteArray
+ * 字符串的字节，直接引用文档数据而不复制
+ */
+QByteArray QtRencodeDocument::toBytes() const {
+  if (type() != String) return QByteArray();
+  quint8 c = m_data.at(m_offset);
+  const QtRencode::TypeInfo &info = QtRencode::TYPE_TABLE[c];
+  int size, digits = 0;
+  if (info.kind == QtRencode::KIND_FIXED_STR) {
+    size = info.size;
+  } else if (!QtRencode::read_str_header(m_data, m_offset, &size, &digits)) {
+    return QByteArray();
+  }
+  qint64 start = m_offset + 1 + digits;
+  if (start + size > m_data.size()) return QByteArray();
+  return QByteArray::fromRawData(m_data.constData() + start, size);
+}
+
+/**
+ * @brief QtRencodeDocument::toVariant
+ * @param options
+ * @return QVariant
+ * 只解码该值（含其子元素）
+ */
+QVariant QtRencodeDocument::toVariant(const QtRencode::Options &options) const {
+  if (!isValid()) return QVariant();
+  unsigned int pos = m_offset;
+  return QtRencode::decode(m_data, &pos, options);
+}
+
+QtRencodeDocument QtRencodeDocument::element(int i) const {
+  if (i < 0 || !scan_to(i)) return QtRencodeDocument();
+  return QtRencodeDocument(m_data, m_index->offsets.at(i));
+}
+
+/**
+ * @brief QtRencodeDocument::scan_to
+ * @param i
+ * @return bool
+ * 记下前i + 1个元素的偏移，元素不存在或数据格式错误时返回false
+ */
+bool QtRencodeDocument::scan_to(int i) const {
+  if (m_index.isNull()) return false;
+  Index &index = *m_index;
+  const QtRencode::TypeInfo &info =
+      QtRencode::TYPE_TABLE[(quint8)m_data.at(m_offset)];
+  bool fixed = info.kind == QtRencode::KIND_FIXED_LIST ||
+               info.kind == QtRencode::KIND_FIXED_DICT;
+  int count = info.kind == QtRencode::KIND_FIXED_DICT ? info.embedded * 2
+                                                       : info.embedded;
+  const char *data = m_data.constData();
+  while (index.offsets.size() <= i && !index.complete && !index.error) {
+    if (fixed && index.offsets.size() == count) {
+      index.complete = true;
+      break;
+    }
+    if (index.next >= m_data.size()) {
+      index.error = true;
+      break;
+    }
+    if (!fixed && (quint8)data[index.next] == QtRencode::CHR_TERM) {
+      index.complete = true;
+      break;
+    }
+    qint64 end = QtRencode::skip_value(data, m_data.size(), index.next);
+    if (end < 0) {
+      index.error = true;
+      break;
+    }
+    index.offsets.append(index.next);
+    index.next = end;
+  }
+  return i < index.offsets.size();
+}
@@ -0,0 +1,70 @@
+﻿#ifndef QTRENCODEDOCUMENT_H
+#define QTRENCODEDOCUMENT_H
+
+#pragma once
+
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QVariant>
+#include <QVector>
+
+#include "qtrencode.h"
+
+/**
+ * @brief The QtRencodeDocument class
+ * 只读、按需解析的rencode文档。构造时不解码任何数据，访问容器的元素时
+ * 才按类型码跳过前面的元素并记下各元素的偏移。容器文档构造时即建立
+ * 偏移表，之后的副本共享已记下的偏移；at()等每次返回的子文档各自从头
+ * 扫描，需要反复访问同一个子容器时应保留返回的文档。
+ * 只取msg.at(0)时其余元素不会被扫描，标量只在取值时解码。
+ * 文档通过隐式共享持有数据，toBytes()返回的字节串直接引用数据，
+ * 在文档（或其任一子文档）存在期间有效
+ */
+class QtRencodeDocument {
+ public:
+  enum Type { Invalid, None, Bool, Int, Float, String, List, Dict };
+
+  QtRencodeDocument();
+  explicit QtRencodeDocument(const QByteArray &data);
+
+  bool isValid() const { return type() != Invalid; }
+  Type type() const;
+  int size() const;
+
+  QtRencodeDocument at(int i) const;
+  QtRencodeDocument keyAt(int i) const;
+  QtRencodeDocument valueAt(int i) const;
+  QtRencodeDocument value(const QByteArray &key) const;
+
+  bool toBool() const;
+  qint64 toInt() const;
+  double toDouble() const;
+  QByteArray toBytes() const;
+  QVariant toVariant(
+      const QtRencode::Options &options = QtRencode::Options()) const;
+
+  // 该值在数据中的偏移
+  qint64 offset() const { return m_offset; }
+
+ private:
+  // 容器元素的偏移，字典的键和值交替存放
+  struct Index {
+    QVector<qint64> offsets;
+    // 下一个未扫描元素的偏移
+    qint64 next;
+    bool complete;
+    bool error;
+  };
+
+  QtRencodeDocument(const QByteArray &data, qint64 offset);
+  void init_index();
+  QtRencodeDocument element(int i) const;
+  bool scan_to(int i) const;
+
+  QByteArray m_data;
+  qint64 m_offset;
+  // 只有列表和字典有
+  QSharedPointer<Index> m_index;
+};
+
+#endif  // QTRENCODEDOCUMENT_H
@@ -0,0 +1,40 @@
+﻿#include "qtrencodekeycache.h"
+
+QtRencodeKeyCache::QtRencodeKeyCache(bool threadSafe, int maxSize)
+    : m_threadSafe(threadSafe), m_maxSize(maxSize) {}
+
+/**
+ * @brief QtRencodeKeyCache::find
+ * @param key 键的原始字节，可以是引用输入数据的fromRawData
+ * @param value
+ * @return bool
+ */
+bool QtRencodeKeyCache::find(const QByteArray &key, QString *value) const {
+  QReadLocker locker(m_threadSafe ? &m_lock : NULL);
+  auto it = m_keys.constFind(key);
+  if (it == m_keys.constEnd()) return false;
+  value[0] = it.value();
+  return true;
+}
+
+/**
+ * @brief QtRencodeKeyCache::insert
+ * @param key
+ * @param value
+ * 复制一份key后加入，缓存已满时忽略
+ */
+void QtRencodeKeyCache::insert(const QByteArray &key, const QString &value) {
+  QWriteLocker locker(m_threadSafe ? &m_lock : NULL);
+  if (m_keys.size() >= m_maxSize) return;
+  m_keys.insert(QByteArray(key.constData(), key.size()), value);
+}
+
+int QtRencodeKeyCache::size() const {
+  QReadLocker locker(m_threadSafe ? &m_lock : NULL);
+  return m_keys.size();
+}
+
+void QtRencodeKeyCache::clear() {
+  QWriteLocker locker(m_threadSafe ? &m_lock : NULL);
+  m_keys.clear();
+}
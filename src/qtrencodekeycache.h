@@ -0,0 +1,41 @@
+﻿#ifndef QTRENCODEKEYCACHE_H
+#define QTRENCODEKEYCACHE_H
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+
+/**
+ * @brief The QtRencodeKeyCache class
+ * json模式下字典键的驻留缓存，把键的原始字节映射到已构造好的QString。
+ * 通过QtRencode::Options::keyCache传给解码函数后，重复出现的键直接共享
+ * 缓存中的QString（隐式共享，只增加引用计数），不再转换编码也不再分配。
+ * threadSafe为false时只能在一个线程中使用（如每个解码器一个）；
+ * 为true时可在多个线程间共享，查找只加读锁。
+ * 键的个数达到maxSize后不再加入新键，已有的键继续命中
+ */
+class QtRencodeKeyCache {
+ public:
+  static const int DEFAULT_MAX_SIZE = 4096;
+
+  explicit QtRencodeKeyCache(bool threadSafe = false,
+                             int maxSize = DEFAULT_MAX_SIZE);
+
+  bool find(const QByteArray &key, QString *value) const;
+  void insert(const QByteArray &key, const QString &value);
+  int size() const;
+  void clear();
+
+ private:
+  Q_DISABLE_COPY(QtRencodeKeyCache)
+
+  QHash<QByteArray, QString> m_keys;
+  bool m_threadSafe;
+  int m_maxSize;
+  mutable QReadWriteLock m_lock;
+};
+
+#endif  // QTRENCODEKEYCACHE_H
@@ -0,0 +1,310 @@
+﻿#include "qtrencodelog.h"
+
+#include <QtEndian>
+
+QtRencodeLogWriter::QtRencodeLogWriter()
+    : m_interval(QtRencodeLog::DEFAULT_INDEX_INTERVAL),
+      m_count(0),
+      m_lastIndex(0),
+      m_error(false) {}
+
+QtRencodeLogWriter::~QtRencodeLogWriter() { close(); }
+
+/**
+ * @brief QtRencodeLogWriter::open
+ * @param fileName
+ * @param indexInterval 每多少条记录写一个索引帧
+ * @param mode
+ * @return bool
+ * Truncate模式新建（或清空）日志文件并写入文件头。Append模式下文件
+ * 不存在或为空时同样新建，否则接着原有的记录写，文件头不对时返回false
+ */
+bool QtRencodeLogWriter::open(const QString &fileName, int indexInterval,
+                              OpenMode mode) {
+  close();
+  m_interval = qMax(1, indexInterval);
+  m_count = 0;
+  m_pending.clear();
+  m_lastIndex = 0;
+  m_error = false;
+  m_file.setFileName(fileName);
+  if (mode == Append && m_file.exists() && m_file.size() > 0)
+    return recover(fileName);
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+  char header[QtRencodeLog::FILE_HEADER_SIZE];
+  memcpy(header, QtRencodeLog::fileMagic(), 4);
+  qToBigEndian<quint32>(QtRencodeLog::VERSION, header + 4);
+  if (m_file.write(header, sizeof(header)) != sizeof(header)) m_error = true;
+  return !m_error;
+}
+
+/**
+ * @brief QtRencodeLogWriter::append
+ * @param value
+ * @param options
+ * @return QtRencode::Result
+ * 编码并追加一条记录，编码失败时不写入；写入失败时error为NoError，
+ * 之后的flush()和close()返回false
+ */
+QtRencode::Result QtRencodeLogWriter::append(
+    const QVariant &value, const QtRencode::Options &options) {
+  QtRencode::Result result = QtRencode::dumps(value, &m_scratch, options);
+  if (result.ok()) appendEncoded(m_scratch);
+  return result;
+}
+
+/**
+ * @brief QtRencodeLogWriter::appendEncoded
+ * @param data 一个已编码的值
+ * @return bool
+ * 追加一条已编码的记录，不检查其内容
+ */
+bool QtRencodeLogWriter::appendEncoded(const QByteArray &data) {
+  if (!isOpen() || m_error) return false;
+  m_pending.append(m_file.pos());
+  if (!write_frame(QtRencodeLog::FRAME_RECORD, data)) return false;
+  m_count++;
+  if (m_pending.size() >= m_interval) return write_index();
+  return true;
+}
+
+bool QtRencodeLogWriter::flush() {
+  if (!isOpen() || m_error) return false;
+  return m_file.flush();
+}
+
+/**
+ * @brief QtRencodeLogWriter::close
+ * @return bool
+ * 写出剩余记录的索引帧和文件尾并关闭文件
+ */
+bool QtRencodeLogWriter::close() {
+  if (!isOpen()) return !m_error;
+  if (!m_pending.isEmpty()) write_index();
+  char footer[QtRencodeLog::FOOTER_SIZE];
+  qToBigEndian<quint64>(m_lastIndex, footer);
+  qToBigEndian<quint64>(m_count, footer + 8);
+  memcpy(footer + 16, QtRencodeLog::footerMagic(), 8);
+  if (!m_error && m_file.write(footer, sizeof(footer)) != sizeof(footer))
+    m_error = true;
+  m_file.close();
+  return !m_error;
+}
+
+/**
+ * @brief QtRencodeLogWriter::recover
+ * @param fileName
+ * @return bool
+ * 用QtRencodeLogReader载入已有的记录偏移，截掉文件尾或末尾不完整的帧，
+ * 最后一个索引帧之后的记录留待下一个索引帧
+ */
+bool QtRencodeLogWriter::recover(const QString &fileName) {
+  qint64 end;
+  {
+    QtRencodeLogReader reader;
+    if (!reader.open(fileName)) return false;
+    m_count = reader.m_offsets.size();
+    m_lastIndex = reader.m_lastIndex;
+    for (int i = 0; i < reader.m_offsets.size(); i++) {
+      if (reader.m_offsets.at(i) > m_lastIndex)
+        m_pending.append(reader.m_offsets.at(i));
+    }
+    end = reader.m_end;
+  }
+  if (!m_file.open(QIODevice::ReadWrite)) return false;
+  if (!m_file.resize(end) || !m_file.seek(end)) {
+    m_file.close();
+    return false;
+  }
+  return true;
+}
+
+bool QtRencodeLogWriter::write_frame(char kind, const QByteArray &payload) {
+  char header[QtRencodeLog::FRAME_HEADER_SIZE] = {kind};
+  qToBigEndian<quint32>(payload.size(), header + 1);
+  if (m_file.write(header, sizeof(header)) != sizeof(header) ||
+      m_file.write(payload) != payload.size())
+    m_error = true;
+  return !m_error;
+}
+
+/**
+ * @brief QtRencodeLogWriter::write_index
+ * @return bool
+ * 把尚未索引的记录偏移写成一个索引帧，并链接到上一个索引帧
+ */
+bool QtRencodeLogWriter::write_index() {
+  QByteArray payload;
+  payload.resize(12 + m_pending.size() * 8);
+  char *p = payload.data();
+  qToBigEndian<quint64>(m_lastIndex, p);
+  qToBigEndian<quint32>(m_pending.size(), p + 8);
+  for (int i = 0; i < m_pending.size(); i++)
+    qToBigEndian<quint64>(m_pending.at(i), p + 12 + i * 8);
+  qint64 offset = m_file.pos();
+  if (!write_frame(QtRencodeLog::FRAME_INDEX, payload)) return false;
+  m_lastIndex = offset;
+  m_pending.clear();
+  return true;
+}
+
+QtRencodeLogReader::QtRencodeLogReader()
+    : m_lastIndex(0), m_end(0), m_complete(false) {}
+
+/**
+ * @brief QtRencodeLogReader::open
+ * @param fileName
+ * @return bool
+ * 映射日志文件并载入索引，文件头不对时返回false
+ */
+bool QtRencodeLogReader::open(const QString &fileName) {
+  close();
+  if (!m_file.open(fileName)) return false;
+  if (m_file.size() < QtRencodeLog::FILE_HEADER_SIZE ||
+      memcmp(m_file.constData(), QtRencodeLog::fileMagic(), 4) != 0 ||
+      qFromBigEndian<quint32>(m_file.constData() + 4) !=
+          QtRencodeLog::VERSION) {
+    m_file.close();
+    return false;
+  }
+  m_complete = load_index();
+  if (!m_complete) scan();
+  return true;
+}
+
+void QtRencodeLogReader::close() {
+  m_file.close();
+  m_offsets.clear();
+  m_lastIndex = 0;
+  m_end = 0;
+  m_complete = false;
+}
+
+/**
+ * @brief QtRencodeLogReader::record
+ * @param i
+ * @return QByteArray
+ * 第i条记录的编码数据，直接引用映射，不复制。m_offsets中的偏移在载入时
+ * 都已检查过是完整的记录帧
+ */
+QByteArray QtRencodeLogReader::record(qint64 i) const {
+  if (i < 0 || i >= m_offsets.size()) return QByteArray();
+  char kind;
+  qint64 length;
+  frame_at(m_offsets.at(int(i)), &kind, &length);
+  qint64 offset = m_offsets.at(int(i)) + QtRencodeLog::FRAME_HEADER_SIZE;
+  return QByteArray::fromRawData((const char *)m_file.constData() + offset,
+                                 int(length));
+}
+
+/**
+ * @brief QtRencodeLogReader::read
+ * @param i
+ * @param value
+ * @param options
+ * @param limits
+ * @return QtRencode::Result
+ * 解码第i条记录，错误位置为记录内的偏移，i越界时为TruncatedData
+ */
+QtRencode::Result QtRencodeLogReader::read(
+    qint64 i, QVariant *value, const QtRencode::Options &options,
+    const QtRencode::Limits &limits) const {
+  return QtRencode::loads(record(i), value, options, limits);
+}
+
+/**
+ * @brief QtRencodeLogReader::frame_at
+ * @param offset
+ * @param kind
+ * @param length 负载长度
+ * @return bool
+ * 读取offset处的帧头，整个帧不在文件内或长度超过QByteArray的上限时
+ * 返回false
+ */
+bool QtRencodeLogReader::frame_at(qint64 offset, char *kind,
+                                  qint64 *length) const {
+  const uchar *data = m_file.constData();
+  if (offset < QtRencodeLog::FILE_HEADER_SIZE ||
+      offset + QtRencodeLog::FRAME_HEADER_SIZE > m_file.size())
+    return false;
+  kind[0] = data[offset];
+  length[0] = qFromBigEndian<quint32>(data + offset + 1);
+  return length[0] <= INT_MAX &&
+         offset + QtRencodeLog::FRAME_HEADER_SIZE + length[0] <= m_file.size();
+}
+
+/**
+ * @brief QtRencodeLogReader::load_index
+ * @return bool
+ * 从文件尾沿索引帧链载入全部记录偏移。文件尾或索引帧不完整、索引帧链
+ * 不是严格向前，或记录偏移处不是完整的记录帧时返回false，改为扫描
+ */
+bool QtRencodeLogReader::load_index() {
+  qint64 size = m_file.size();
+  if (size < QtRencodeLog::FILE_HEADER_SIZE + QtRencodeLog::FOOTER_SIZE)
+    return false;
+  const uchar *footer = m_file.constData() + size - QtRencodeLog::FOOTER_SIZE;
+  if (memcmp(footer + 16, QtRencodeLog::footerMagic(), 8) != 0) return false;
+  qint64 index = qFromBigEndian<quint64>(footer);
+  qint64 count = qFromBigEndian<quint64>(footer + 8);
+  if (count < 0 || count > qMin(size >> 3, qint64(INT_MAX))) return false;
+  // 沿链从后往前填入
+  m_offsets.resize(int(count));
+  qint64 filled = count;
+  while (index != 0) {
+    char kind;
+    qint64 length;
+    if (!frame_at(index, &kind, &length) || kind != QtRencodeLog::FRAME_INDEX ||
+        length < 12)
+      break;
+    const uchar *p =
+        m_file.constData() + index + QtRencodeLog::FRAME_HEADER_SIZE;
+    qint64 n = qFromBigEndian<quint32>(p + 8);
+    if (12 + n * 8 != length || n > filled) break;
+    // 记录帧都在所属的索引帧之前
+    qint64 i = 0;
+    for (; i < n; i++) {
+      qint64 offset = qFromBigEndian<quint64>(p + 12 + i * 8);
+      if (offset >= index || !frame_at(offset, &kind, &length) ||
+          kind != QtRencodeLog::FRAME_RECORD)
+        break;
+      m_offsets[int(filled - n + i)] = offset;
+    }
+    if (i < n) break;
+    filled -= n;
+    // 上一个索引帧必须在当前帧之前，否则损坏的链会循环
+    qint64 prev = qFromBigEndian<quint64>(p);
+    if (prev != 0 && (prev >= index || prev < QtRencodeLog::FILE_HEADER_SIZE))
+      break;
+    index = prev;
+  }
+  if (index != 0 || filled != 0) {
+    m_offsets.clear();
+    return false;
+  }
+  m_lastIndex = qFromBigEndian<quint64>(footer);
+  m_end = size - QtRencodeLog::FOOTER_SIZE;
+  return true;
+}
+
+/**
+ * @brief QtRencodeLogReader::scan
+ * 没有可用的文件尾时，按帧头顺序找出全部完整的记录帧
+ */
+void QtRencodeLogReader::scan() {
+  m_offsets.clear();
+  m_lastIndex = 0;
+  qint64 offset = QtRencodeLog::FILE_HEADER_SIZE;
+  char kind;
+  qint64 length;
+  while (frame_at(offset, &kind, &length)) {
+    if (kind == QtRencodeLog::FRAME_RECORD)
+      m_offsets.append(offset);
+    else if (kind == QtRencodeLog::FRAME_INDEX)
+      m_lastIndex = offset;
+    else
+      break;
+    offset += QtRencodeLog::FRAME_HEADER_SIZE + length;
+  }
+  m_end = offset;
+}
@@ -0,0 +1,128 @@
+﻿#ifndef QTRENCODELOG_H
+#define QTRENCODELOG_H
+
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+#include "qtrencode.h"
+#include "qtrencodemappedfile.h"
+
+/**
+ * @brief The QtRencodeLog class
+ * 只追加的记录日志格式，每条记录是一个编码后的值：
+ *   文件头   "QRLG" + 版本号（quint32）
+ *   记录帧   'R' + 长度（quint32）+ 编码后的值
+ *   索引帧   'I' + 长度（quint32）+ 上一个索引帧的偏移（quint64，没有为0）
+ *            + 记录数（quint32）+ 各记录帧的偏移（quint64）
+ *   文件尾   最后一个索引帧的偏移（quint64）+ 记录总数（quint64）+ "QRLGFOOT"
+ * 整数都是大端序。每写满一定条数的记录追加一个索引帧，各索引帧依次相连，
+ * 读取时从文件尾找到全部记录的偏移，定位第N条记录不需要读前面的记录。
+ * 没有文件尾（写入过程中断）的文件按帧头顺序扫描，丢弃末尾不完整的帧
+ */
+class QtRencodeLog {
+ public:
+  static const char FRAME_RECORD = 'R';
+  static const char FRAME_INDEX = 'I';
+  // 帧类型和长度
+  static const int FRAME_HEADER_SIZE = 5;
+  static const int FILE_HEADER_SIZE = 8;
+  static const int FOOTER_SIZE = 24;
+  static const quint32 VERSION = 1;
+  // 默认每多少条记录写一个索引帧
+  static const int DEFAULT_INDEX_INTERVAL = 1024;
+
+  static const char *fileMagic() { return "QRLG"; }
+  static const char *footerMagic() { return "QRLGFOOT"; }
+};
+
+/**
+ * @brief The QtRencodeLogWriter class
+ * 按QtRencodeLog格式写记录日志，close()或析构时写出最后的索引帧和文件尾。
+ * Append模式接着已有的日志写：去掉文件尾（或末尾不完整的帧），
+ * 新的索引帧接在原有的索引帧链之后
+ */
+class QtRencodeLogWriter {
+ public:
+  enum OpenMode {
+    // 新建或清空
+    Truncate,
+    // 接着已有的记录写
+    Append
+  };
+
+  QtRencodeLogWriter();
+  ~QtRencodeLogWriter();
+
+  bool open(const QString &fileName,
+            int indexInterval = QtRencodeLog::DEFAULT_INDEX_INTERVAL,
+            OpenMode mode = Truncate);
+  bool isOpen() const { return m_file.isOpen(); }
+  QtRencode::Result append(
+      const QVariant &value,
+      const QtRencode::Options &options = QtRencode::Options());
+  bool appendEncoded(const QByteArray &data);
+  qint64 count() const { return m_count; }
+  bool flush();
+  bool close();
+
+ private:
+  Q_DISABLE_COPY(QtRencodeLogWriter)
+  bool recover(const QString &fileName);
+  bool write_frame(char kind, const QByteArray &payload);
+  bool write_index();
+
+  QFile m_file;
+  int m_interval;
+  qint64 m_count;
+  // 尚未写入索引帧的记录帧偏移
+  QVector<qint64> m_pending;
+  qint64 m_lastIndex;
+  bool m_error;
+  QByteArray m_scratch;
+};
+
+/**
+ * @brief The QtRencodeLogReader class
+ * 随机读取记录日志。文件通过QtRencodeMappedFile映射，
+ * record()返回直接引用映射的字节串，在close()前有效
+ */
+class QtRencodeLogReader {
+ public:
+  QtRencodeLogReader();
+
+  bool open(const QString &fileName);
+  void close();
+  bool isOpen() const { return m_file.isOpen(); }
+  // 文件有完整的文件尾，没有则是扫描得到的记录
+  bool isComplete() const { return m_complete; }
+
+  qint64 count() const { return m_offsets.size(); }
+  QByteArray record(qint64 i) const;
+  QtRencode::Result read(
+      qint64 i, QVariant *value,
+      const QtRencode::Options &options = QtRencode::Options(),
+      const QtRencode::Limits &limits = QtRencode::Limits()) const;
+
+ private:
+  Q_DISABLE_COPY(QtRencodeLogReader)
+  friend class QtRencodeLogWriter;
+  bool frame_at(qint64 offset, char *kind, qint64 *length) const;
+  bool load_index();
+  void scan();
+
+  QtRencodeMappedFile m_file;
+  // 各记录帧的偏移
+  QVector<qint64> m_offsets;
+  // 最后一个索引帧的偏移，没有为0
+  qint64 m_lastIndex;
+  // 文件尾或末尾不完整的帧的起始位置，追加时从这里接着写
+  qint64 m_end;
+  bool m_complete;
+};
+
+#endif  // QTRENCODELOG_H
@@ -0,0 +1,123 @@
+﻿#include "qtrencodemappedfile.h"
+
+QtRencodeMappedFile::QtRencodeMappedFile() : m_data(NULL), m_size(0) {}
+
+QtRencodeMappedFile::QtRencodeMappedFile(const QString &fileName)
+    : m_data(NULL), m_size(0) {
+  open(fileName);
+}
+
+QtRencodeMappedFile::~QtRencodeMappedFile() { close(); }
+
+/**
+ * @brief QtRencodeMappedFile::open
+ * @param fileName
+ * @return bool
+ * 只读打开并映射整个文件，之前打开的文件先关闭。空文件不映射，也算打开成功
+ */
+bool QtRencodeMappedFile::open(const QString &fileName) {
+  close();
+  m_file.setFileName(fileName);
+  if (!m_file.open(QIODevice::ReadOnly)) return false;
+  qint64 size = m_file.size();
+  if (size > 0) {
+    m_data = m_file.map(0, size);
+    if (m_data == NULL) {
+      m_file.close();
+      return false;
+    }
+  }
+  m_size = size;
+  return true;
+}
+
+/**
+ * @brief QtRencodeMappedFile::close
+ * 解除映射并关闭文件，之前解码出的引用映射的字节串随之失效
+ */
+void QtRencodeMappedFile::close() {
+  if (m_data != NULL) m_file.unmap(m_data);
+  m_data = NULL;
+  m_size = 0;
+  if (m_file.isOpen()) m_file.close();
+}
+
+/**
+ * @brief QtRencodeMappedFile::window
+ * @param offset
+ * @return QByteArray
+ * 从offset开始、不超过INT_MAX字节的只读视图，不复制
+ */
+QByteArray QtRencodeMappedFile::window(qint64 offset) const {
+  if (offset < 0 || offset >= m_size) return QByteArray();
+  return QByteArray::fromRawData((const char *)m_data + offset,
+                                 int(qMin(m_size - offset, qint64(INT_MAX))));
+}
+
+/**
+ * @brief QtRencodeMappedFile::load
+ * @param value
+ * @param options
+ * @param limits
+ * @return QtRencode::Result
+ * 解码文件开头的一个值
+ */
+QtRencode::Result QtRencodeMappedFile::load(
+    QVariant *value, const QtRencode::Options &options,
+    const QtRencode::Limits &limits) const {
+  unsigned int pos = 0;
+  return decode_at(window(0), 0, value, &pos, options, limits);
+}
+
+QtRencodeMappedFile::Iterator QtRencodeMappedFile::values(
+    const QtRencode::Options &options, const QtRencode::Limits &limits) const {
+  return Iterator(this, options, limits);
+}
+
+/**
+ * @brief QtRencodeMappedFile::decode_at
+ * @param window
+ * @param offset window在文件中的偏移，用于换算错误位置
+ * @param value
+ * @param pos 解码后为该值之后在window中的位置
+ * @param options
+ * @param limits
+ * @return QtRencode::Result
+ */
+QtRencode::Result QtRencodeMappedFile::decode_at(
+    const QByteArray &window, qint64 offset, QVariant *value,
+    unsigned int *pos, const QtRencode::Options &options,
+    const QtRencode::Limits &limits) {
+  QtRencode::DecodeContext ctx = {options, limits, 0, 0, QtRencode::NoError, 0,
+                                  NULL};
+  value[0] = QtRencode::decode(window, pos, &ctx);
+  QtRencode::Result result;
+  if (Q_UNLIKELY(ctx.error != QtRencode::NoError)) {
+    result.error = ctx.error;
+    result.offset = offset + ctx.errorOffset;
+    if (ctx.errorOffset < (unsigned int)window.size())
+      result.typecode = window.at(ctx.errorOffset);
+    value[0] = QVariant();
+  }
+  return result;
+}
+
+QtRencodeMappedFile::Iterator::Iterator(const QtRencodeMappedFile *file,
+                                        const QtRencode::Options &options,
+                                        const QtRencode::Limits &limits)
+    : m_file(file), m_options(options), m_limits(limits), m_offset(0) {}
+
+/**
+ * @brief QtRencodeMappedFile::Iterator::next
+ * @param value
+ * @return QtRencode::Result
+ * 解码下一个值并前进。出错时不前进，错误位置为文件中的偏移
+ */
+QtRencode::Result QtRencodeMappedFile::Iterator::next(QVariant *value) {
+  unsigned int pos = 0;
+  QtRencode::Result result =
+      decode_at(m_file->window(m_offset), m_offset, value, &pos, m_options,
+                m_limits);
+  if (result.ok()) m_offset += pos;
+  return result;
+}
@@ -0,0 +1,77 @@
+﻿#ifndef QTRENCODEMAPPEDFILE_H
+#define QTRENCODEMAPPEDFILE_H
+
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVariant>
+
+#include "qtrencode.h"
+
+/**
+ * @brief The QtRencodeMappedFile class
+ * 用QFile::map把rencode文件映射到内存，直接在映射上解码，不先读入再复制。
+ * Options::useJson为false且zeroCopy为true时，解码出的字节串直接引用映射，
+ * 在close()或对象析构前有效。文件可以大于QByteArray的上限，
+ * 只要其中每个顶层值不超过INT_MAX字节
+ */
+class QtRencodeMappedFile {
+ public:
+  /**
+   * @brief The Iterator class
+   * 依次取出文件中拼接的各个顶层值
+   */
+  class Iterator {
+   public:
+    bool atEnd() const { return m_offset >= m_file->m_size; }
+    // 下一个值在文件中的偏移
+    qint64 offset() const { return m_offset; }
+    QtRencode::Result next(QVariant *value);
+
+   private:
+    friend class QtRencodeMappedFile;
+    Iterator(const QtRencodeMappedFile *file,
+             const QtRencode::Options &options,
+             const QtRencode::Limits &limits);
+
+    const QtRencodeMappedFile *m_file;
+    QtRencode::Options m_options;
+    QtRencode::Limits m_limits;
+    qint64 m_offset;
+  };
+
+  QtRencodeMappedFile();
+  explicit QtRencodeMappedFile(const QString &fileName);
+  ~QtRencodeMappedFile();
+
+  bool open(const QString &fileName);
+  void close();
+  bool isOpen() const { return m_file.isOpen(); }
+
+  const uchar *constData() const { return m_data; }
+  qint64 size() const { return m_size; }
+  QByteArray window(qint64 offset) const;
+
+  QtRencode::Result load(
+      QVariant *value,
+      const QtRencode::Options &options = QtRencode::Options(),
+      const QtRencode::Limits &limits = QtRencode::Limits()) const;
+  Iterator values(
+      const QtRencode::Options &options = QtRencode::Options(),
+      const QtRencode::Limits &limits = QtRencode::Limits()) const;
+
+ private:
+  Q_DISABLE_COPY(QtRencodeMappedFile)
+  static QtRencode::Result decode_at(const QByteArray &window, qint64 offset,
+                                     QVariant *value, unsigned int *pos,
+                                     const QtRencode::Options &options,
+                                     const QtRencode::Limits &limits);
+
+  QFile m_file;
+  uchar *m_data;
+  qint64 m_size;
+};
+
+#endif  // QTRENCODEMAPPEDFILE_H
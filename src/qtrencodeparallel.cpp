@@ -0,0 +1,331 @@
+﻿#include "qtrencodeparallel.h"
+
+const int QtRencodeParallel::MIN_CHUNK_ELEMENTS;
+
+// 任务由调用线程删除，以便在wait_tasks中取回尚未开始的任务
+class QtRencodeParallel::DecodeTask : public QRunnable {
+ public:
+  DecodeTask(const QByteArray &data, bool dict,
+             const QtRencode::Options &options,
+             const QtRencode::Limits &limits, Part *part, QSemaphore *done)
+      : m_data(data),
+        m_dict(dict),
+        m_options(options),
+        m_limits(limits),
+        m_part(part),
+        m_done(done) {
+    setAutoDelete(false);
+  }
+
+  void run() override {
+    decode_part(m_data, m_dict, m_options, m_limits, m_part);
+    m_done->release();
+  }
+
+ private:
+  const QByteArray &m_data;
+  bool m_dict;
+  const QtRencode::Options &m_options;
+  const QtRencode::Limits &m_limits;
+  Part *m_part;
+  QSemaphore *m_done;
+};
+
+template <typename Iterator>
+class QtRencodeParallel::EncodeTask : public QRunnable {
+ public:
+  EncodeTask(Iterator it, const QtRencode::Options &options, Chunk *chunk,
+             QSemaphore *done)
+      : m_it(it), m_options(options), m_chunk(chunk), m_done(done) {
+    setAutoDelete(false);
+  }
+
+  void run() override {
+    encode_chunk(m_it, m_options, m_chunk, m_options.maxOutputSize);
+    m_done->release();
+  }
+
+ private:
+  Iterator m_it;
+  const QtRencode::Options &m_options;
+  Chunk *m_chunk;
+  QSemaphore *m_done;
+};
+
+/**
+ * @brief QtRencodeParallel::loads
+ * @param data
+ * @param value
+ * @param options
+ * @param limits
+ * @param pool 为NULL时使用QThreadPool::globalInstance()
+ * @return QtRencode::Result
+ * 在线程池中并行解码顶层的CHR_LIST或CHR_DICT，调用线程也解码其中一段，
+ * 全部完成后才返回
+ */
+QtRencode::Result QtRencodeParallel::loads(const QByteArray &data,
+                                           QVariant *value,
+                                           const QtRencode::Options &options,
+                                           const QtRencode::Limits &limits,
+                                           QThreadPool *pool) {
+  if (pool == NULL) pool = QThreadPool::globalInstance();
+  quint8 c = data.isEmpty() ? 0 : data.at(0);
+  bool dict = c == QtRencode::CHR_DICT;
+  if ((c != QtRencode::CHR_LIST && !dict) || limits.maxDepth < 1 ||
+      pool->maxThreadCount() < 2)
+    return QtRencode::loads(data, value, options, limits);
+
+  // 扫描元素边界，格式错误或数据不完整时交给串行解码报告错误
+  const char *p = data.constData();
+  qint64 size = data.size();
+  qint64 pos = 1;
+  QVector<unsigned int> starts;
+  while (pos < size && (quint8)p[pos] != QtRencode::CHR_TERM) {
+    starts.append(pos);
+    pos = QtRencode::skip_value(p, size, pos);
+    if (pos >= 0 && dict) pos = QtRencode::skip_value(p, size, pos);
+    if (pos < 0) break;
+  }
+  int count = starts.size();
+  if (pos < 0 || pos >= size || count < MIN_ELEMENTS ||
+      count > limits.maxContainerSize)
+    return QtRencode::loads(data, value, options, limits);
+
+  int per = qMax(MIN_CHUNK_ELEMENTS,
+                 (count + pool->maxThreadCount() * 4 - 1) /
+                     (pool->maxThreadCount() * 4));
+  QVector<Part> parts((count + per - 1) / per);
+  for (int i = 0; i < parts.size(); i++) {
+    parts[i].begin = starts.at(i * per);
+    parts[i].count = qMin(per, count - i * per);
+  }
+  QSemaphore done;
+  QVector<QRunnable *> tasks;
+  for (int i = 1; i < parts.size(); i++) {
+    tasks.append(new DecodeTask(data, dict, options, limits, &parts[i], &done));
+    pool->start(tasks.last());
+  }
+  decode_part(data, dict, options, limits, &parts[0]);
+  wait_tasks(pool, tasks, &done);
+
+  qint64 nodes = 1;
+  for (int i = 0; i < parts.size(); i++) {
+    if (parts.at(i).error != QtRencode::NoError)
+      return QtRencode::loads(data, value, options, limits);
+    nodes += parts.at(i).nodes;
+  }
+  if (nodes > limits.maxNodes)
+    return QtRencode::loads(data, value, options, limits);
+
+  if (!dict) {
+    QVariantList list;
+    list.reserve(count);
+    for (int i = 0; i < parts.size(); i++) list.append(parts.at(i).list);
+    value[0] = list;
+  } else if (options.useJson) {
+    QVariantMap json;
+    for (int i = 0; i < parts.size(); i++) {
+      const QVariantMap &part = parts.at(i).json;
+      for (auto it = part.begin(); it != part.end(); ++it)
+        json.insert(it.key(), it.value());
+    }
+    value[0] = json;
+  } else {
+    QMap<QVariant, QVariant> map;
+    for (int i = 0; i < parts.size(); i++) {
+      const QMap<QVariant, QVariant> &part = parts.at(i).map;
+      for (auto it = part.begin(); it != part.end(); ++it)
+        map.insert(it.key(), it.value());
+    }
+    value[0] = QVariant::fromValue<QMap<QVariant, QVariant>>(map);
+  }
+  return QtRencode::Result();
+}
+
+/**
+ * @brief QtRencodeParallel::wait_tasks
+ * @param pool
+ * @param tasks
+ * @param done 每个任务完成时释放一次
+ * 等待全部任务完成后删除它们。尚未开始的任务从线程池取回由调用线程执行，
+ * 因此在线程池已满时（例如在同一线程池的工作线程中调用）也不会死锁
+ */
+void QtRencodeParallel::wait_tasks(QThreadPool *pool,
+                                   const QVector<QRunnable *> &tasks,
+                                   QSemaphore *done) {
+  // 从后往前取，排在队列末尾的任务最不可能已经开始
+  for (int i = tasks.size() - 1; i >= 0; i--)
+    if (pool->tryTake(tasks.at(i))) tasks.at(i)->run();
+  done->acquire(tasks.size());
+  qDeleteAll(tasks);
+}
+
+/**
+ * @brief QtRencodeParallel::decode_part
+ * @param data
+ * @param dict
+ * @param options
+ * @param limits
+ * @param part
+ * 解码一段元素，每段有独立的解码状态，嵌套层数从顶层容器之下开始计
+ */
+void QtRencodeParallel::decode_part(const QByteArray &data, bool dict,
+                                    const QtRencode::Options &options,
+                                    const QtRencode::Limits &limits,
+                                    Part *part) {
+  QtRencode::DecodeContext ctx = {options, limits, 1, 0, QtRencode::NoError, 0,
+                                  NULL};
+  unsigned int pos = part->begin;
+  if (!dict) part->list.reserve(part->count);
+  for (int i = 0; i < part->count && ctx.error == QtRencode::NoError; i++) {
+    if (dict)
+      QtRencode::decode_pair(data, &pos, &ctx, &part->json, &part->map);
+    else
+      part->list.append(QtRencode::decode(data, &pos, &ctx));
+  }
+  part->error = ctx.error;
+  part->nodes = ctx.nodes;
+}
+
+/**
+ * @brief QtRencodeParallel::dumps
+ * @param data
+ * @param out 编码结果，失败时为空
+ * @param options
+ * @param pool 为NULL时使用QThreadPool::globalInstance()
+ * @return QtRencode::Result
+ * 在线程池中并行编码顶层的大列表或大字典，调用线程也编码其中一段，
+ * 全部完成后才返回
+ */
+QtRencode::Result QtRencodeParallel::dumps(const QVariant &data,
+                                           QByteArray *out,
+                                           const QtRencode::Options &options,
+                                           QThreadPool *pool) {
+  if (pool == NULL) pool = QThreadPool::globalInstance();
+  if (pool->maxThreadCount() < 2 || options.maxOutputSize < 1)
+    return QtRencode::dumps(data, out, options);
+  // 与QtRencode::encode的分派顺序相同
+  if (data.type() == QVariant::List) {
+    QVariantList x = data.toList();
+    if (x.size() >= MIN_ELEMENTS)
+      return encode_container(x, QtRencode::CHR_LIST, out, options, pool);
+  } else if (data.type() == QVariant::Map ||
+             data.canConvert<QMap<QVariant, QVariant>>()) {
+    QMap<QVariant, QVariant> map = data.value<QMap<QVariant, QVariant>>();
+    if (map.isEmpty()) {
+      QVariantMap json = data.toMap();
+      if (json.size() >= MIN_ELEMENTS)
+        return encode_container(json, QtRencode::CHR_DICT, out, options, pool);
+    } else if (map.size() >= MIN_ELEMENTS) {
+      return encode_container(map, QtRencode::CHR_DICT, out, options, pool);
+    }
+  }
+  return QtRencode::dumps(data, out, options);
+}
+
+template <typename Container>
+QtRencode::Result QtRencodeParallel::encode_container(
+    const Container &x, quint8 typecode, QByteArray *out,
+    const QtRencode::Options &options, QThreadPool *pool) {
+  typedef typename Container::const_iterator Iterator;
+  int count = x.size();
+  int per = qMax(MIN_CHUNK_ELEMENTS,
+                 (count + pool->maxThreadCount() * 4 - 1) /
+                     (pool->maxThreadCount() * 4));
+  QVector<Chunk> chunks((count + per - 1) / per);
+  QVector<Iterator> begins(chunks.size());
+  Iterator it = x.constBegin();
+  for (int i = 0; i < chunks.size(); i++) {
+    chunks[i].count = qMin(per, count - i * per);
+    begins[i] = it;
+    // QMap的迭代器只能逐个前进，总共也只遍历一遍
+    if (i + 1 < chunks.size())
+      for (int k = 0; k < chunks[i].count; k++) ++it;
+  }
+  QSemaphore done;
+  QVector<QRunnable *> tasks;
+  for (int i = 1; i < chunks.size(); i++) {
+    tasks.append(
+        new EncodeTask<Iterator>(begins[i], options, &chunks[i], &done));
+    pool->start(tasks.last());
+  }
+  encode_chunk(begins[0], options, &chunks[0], options.maxOutputSize);
+  wait_tasks(pool, tasks, &done);
+
+  QtRencode::Result result;
+  qint64 size = 1;
+  for (int i = 0; i < chunks.size(); i++) {
+    const Chunk &chunk = chunks.at(i);
+    if (chunk.failure == QtRencode::NoError &&
+        size + chunk.bytes.size() <= options.maxOutputSize) {
+      size += chunk.bytes.size();
+      continue;
+    }
+    // 本段出错或拼接后超出上限：以剩余的空间重新编码本段，得到与串行编码
+    // 相同的第一个错误及其位置
+    Chunk retry;
+    retry.count = chunk.count;
+    encode_chunk(begins[i], options, &retry, options.maxOutputSize - size);
+    result.error = QtRencode::Error(retry.failure);
+    result.offset = size + retry.failureOffset;
+    out->clear();
+    return result;
+  }
+  if (size + 1 > options.maxOutputSize) {
+    // 放不下结尾的CHR_TERM
+    result.error = QtRencode::OutputTooLarge;
+    result.offset = size;
+    out->clear();
+    return result;
+  }
+  out->resize(int(size + 1));
+  char *p = out->data();
+  *p++ = char(typecode);
+  for (int i = 0; i < chunks.size(); i++) {
+    const QByteArray &bytes = chunks.at(i).bytes;
+    memcpy(p, bytes.constData(), bytes.size());
+    p += bytes.size();
+  }
+  *p = char(QtRencode::CHR_TERM);
+  return result;
+}
+
+/**
+ * @brief QtRencodeParallel::encode_chunk
+ * @param it 本段的第一个元素
+ * @param options
+ * @param chunk
+ * @param maxSize 本段编码结果的上限
+ * 把一段元素编码到本段独立的缓冲区
+ */
+template <typename Iterator>
+void QtRencodeParallel::encode_chunk(Iterator it,
+                                     const QtRencode::Options &options,
+                                     Chunk *chunk, qint64 maxSize) {
+  QtRencodeBuffer buf;
+  buf.setMaxSize(maxSize);
+  for (int i = 0; i < chunk->count; i++, ++it) encode_item(&buf, it, options);
+  chunk->failure = buf.failure();
+  chunk->failureOffset = buf.failureOffset();
+  chunk->bytes = buf.take();
+}
+
+void QtRencodeParallel::encode_item(QtRencodeBuffer *buf,
+                                    QVariantList::const_iterator it,
+                                    const QtRencode::Options &options) {
+  QtRencode::encode(buf, *it, options);
+}
+
+void QtRencodeParallel::encode_item(QtRencodeBuffer *buf,
+                                    QVariantMap::const_iterator it,
+                                    const QtRencode::Options &options) {
+  QtRencode::encode(buf, it.key(), options);
+  QtRencode::encode(buf, it.value(), options);
+}
+
+void QtRencodeParallel::encode_item(QtRencodeBuffer *buf,
+                                    QMap<QVariant, QVariant>::const_iterator it,
+                                    const QtRencode::Options &options) {
+  QtRencode::encode(buf, it.key(), options);
+  QtRencode::encode(buf, it.value(), options);
+}
@@ -0,0 +1,88 @@
+﻿#ifndef QTRENCODEPARALLEL_H
+#define QTRENCODEPARALLEL_H
+
+#pragma once
+
+#include <QByteArray>
+#include <QMap>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QVariant>
+#include <QVector>
+
+#include "qtrencode.h"
+
+/**
+ * @brief The QtRencodeParallel class
+ * 大型顶层列表、字典的并行编解码。解码时先只按类型码扫描出各元素（字典为
+ * 各键值对）的边界，再把元素分成若干段交给线程池分别解码，最后按原顺序
+ * 拼接，结果与QtRencode::loads完全相同。编码时各段分别写入各自的缓冲区，
+ * 再拼接在容器头和CHR_TERM之间，输出与QtRencode::dumps逐字节相同。
+ * 元素较少、不是以CHR_TERM结束的顶层容器或解码出错时按串行处理，
+ * 错误信息也与串行编解码一致
+ */
+class QtRencodeParallel {
+ public:
+  // 顶层元素少于此值时串行解码
+  static const int MIN_ELEMENTS = 4096;
+  // 每段至少包含的元素个数
+  static const int MIN_CHUNK_ELEMENTS = 1024;
+
+  static QtRencode::Result loads(
+      const QByteArray &data, QVariant *value,
+      const QtRencode::Options &options = QtRencode::Options(),
+      const QtRencode::Limits &limits = QtRencode::Limits(),
+      QThreadPool *pool = NULL);
+  static QtRencode::Result dumps(
+      const QVariant &data, QByteArray *out,
+      const QtRencode::Options &options = QtRencode::Options(),
+      QThreadPool *pool = NULL);
+
+ private:
+  class DecodeTask;
+  template <typename Iterator>
+  class EncodeTask;
+
+  // 一段连续元素的解码结果
+  struct Part {
+    unsigned int begin;
+    int count;
+    QVariantList list;
+    QVariantMap json;
+    QMap<QVariant, QVariant> map;
+    QtRencode::Error error;
+    qint64 nodes;
+  };
+
+  // 一段连续元素的编码结果
+  struct Chunk {
+    int count;
+    QByteArray bytes;
+    int failure;
+    qint64 failureOffset;
+  };
+
+  static void wait_tasks(QThreadPool *pool, const QVector<QRunnable *> &tasks,
+                         QSemaphore *done);
+  static void decode_part(const QByteArray &data, bool dict,
+                          const QtRencode::Options &options,
+                          const QtRencode::Limits &limits, Part *part);
+  template <typename Container>
+  static QtRencode::Result encode_container(const Container &x,
+                                            quint8 typecode, QByteArray *out,
+                                            const QtRencode::Options &options,
+                                            QThreadPool *pool);
+  template <typename Iterator>
+  static void encode_chunk(Iterator it, const QtRencode::Options &options,
+                           Chunk *chunk, qint64 maxSize);
+  static void encode_item(QtRencodeBuffer *buf, QVariantList::const_iterator it,
+                          const QtRencode::Options &options);
+  static void encode_item(QtRencodeBuffer *buf, QVariantMap::const_iterator it,
+                          const QtRencode::Options &options);
+  static void encode_item(QtRencodeBuffer *buf,
+                          QMap<QVariant, QVariant>::const_iterator it,
+                          const QtRencode::Options &options);
+};
+
+#endif  // QTRENCODEPARALLEL_H
@@ -0,0 +1,237 @@
+﻿#include "qtrencodestream.h"
+
+QtRencodeStreamDecoder::QtRencodeStreamDecoder(
+    const QtRencode::Options &options, const QtRencode::Limits &limits)
+    : m_options(options),
+      m_limits(limits),
+      m_start(0),
+      m_scan(0),
+      m_nodes(0),
+      m_consumed(0),
+      m_error(false) {
+  // 取出的值不能引用内部缓冲区，缓冲区会被压缩和复用
+  m_options.zeroCopy = false;
+}
+
+/**
+ * @brief QtRencodeStreamDecoder::feed
+ * @param data
+ * 追加收到的数据
+ */
+void QtRencodeStreamDecoder::feed(const QByteArray &data) {
+  if (m_start > 0) {
+    m_buffer.remove(0, m_start);
+    m_consumed += m_start;
+    m_scan -= m_start;
+    m_start = 0;
+  }
+  m_buffer.append(data);
+}
+
+/**
+ * @brief QtRencodeStreamDecoder::feed
+ * @param device
+ * @return qint64
+ * 读入设备当前可读的全部数据，返回读入的字节数
+ */
+qint64 QtRencodeStreamDecoder::feed(QIODevice *device) {
+  QByteArray data = device->readAll();
+  feed(data);
+  return data.size();
+}
+
+/**
+ * @brief QtRencodeStreamDecoder::next
+ * @param value
+ * @return Status
+ * 取出下一个完整的顶层值
+ */
+QtRencodeStreamDecoder::Status QtRencodeStreamDecoder::next(QVariant *value) {
+  if (m_error) return Error;
+  Status status = scan();
+  if (status != Value) return status;
+  m_nodes = 0;
+  QByteArray frame = QByteArray::fromRawData(m_buffer.constData() + m_start,
+                                             m_scan - m_start);
+  QtRencode::Result result =
+      QtRencode::loads(frame, value, m_options, m_limits);
+  if (!result.ok()) {
+    // 结构完整但解码时出错的值
+    m_error = true;
+    m_scan = m_start + int(result.offset);
+    return Error;
+  }
+  m_start = m_scan;
+  return Value;
+}
+
+/**
+ * @brief QtRencodeStreamDecoder::reset
+ * 丢弃全部缓冲数据和错误状态
+ */
+void QtRencodeStreamDecoder::reset() {
+  m_buffer.clear();
+  m_stack.clear();
+  m_start = 0;
+  m_scan = 0;
+  m_nodes = 0;
+  m_consumed = 0;
+  m_error = false;
+}
+
+int QtRencodeStreamDecoder::bufferedSize() const {
+  return m_buffer.size() - m_start;
+}
+
+/**
+ * @brief QtRencodeStreamDecoder::errorOffset
+ * @return qint64
+ * 出错记号在整个数据流中的偏移
+ */
+qint64 QtRencodeStreamDecoder::errorOffset() const {
+  return m_error ? m_consumed + m_scan : -1;
+}
+
+/**
+ * @brief QtRencodeStreamDecoder::scan
+ * @return Status
+ * 从上次停下的位置继续按记号扫描，直到一个顶层值完整或数据不足。
+ * 记号不完整时下次从其开头重新检查，因此计数只在记号完整后增加
+ */
+QtRencodeStreamDecoder::Status QtRencodeStreamDecoder::scan() {
+  const char *data = m_buffer.constData();
+  int size = m_buffer.size();
+  while (m_scan < size) {
+    quint8 typecode = data[m_scan];
+    if (typecode == QtRencode::CHR_TERM) {
+      if (m_stack.isEmpty() || m_stack.last().remaining != -1)
+        return fail(m_scan);
+      m_stack.removeLast();
+      m_scan += 1;
+      if (complete_element()) return Value;
+      continue;
+    }
+    // 与解码时一样，先检查容器的元素个数，再检查元素本身
+    if (!m_stack.isEmpty() && m_stack.last().remaining < 0) {
+      const Level &parent = m_stack.last();
+      qint64 max = qint64(m_limits.maxContainerSize) * (parent.dict ? 2 : 1);
+      if (parent.count >= max) return fail(int(parent.start - m_consumed));
+    }
+    qint64 length = QtRencode::token_length(data, size, m_scan);
+    if (length < 0) return fail(m_scan);
+    const QtRencode::TypeInfo &info = QtRencode::TYPE_TABLE[typecode];
+    // 长字符串的声明长度在内容到齐之前就检查，超出上限的数据不会被缓冲
+    int string = info.kind == QtRencode::KIND_FIXED_STR ? info.size : 0;
+    int digits;
+    if (info.kind == QtRencode::KIND_STR &&
+        !QtRencode::read_str_header(m_buffer, m_scan, &string, &digits))
+      string = 0;
+    bool container = info.kind == QtRencode::KIND_LIST ||
+                     info.kind == QtRencode::KIND_DICT ||
+                     info.kind == QtRencode::KIND_FIXED_LIST ||
+                     info.kind == QtRencode::KIND_FIXED_DICT;
+    int fixed = info.kind == QtRencode::KIND_FIXED_LIST ||
+                        info.kind == QtRencode::KIND_FIXED_DICT
+                    ? info.embedded
+                    : 0;
+    if (m_nodes >= m_limits.maxNodes || string > m_limits.maxStringLength ||
+        fixed > m_limits.maxContainerSize ||
+        (container && m_stack.size() >= m_limits.maxDepth))
+      return fail(m_scan);
+    if (length == 0) return NeedMoreData;
+    qint64 start = m_consumed + m_scan;
+    m_scan += length;
+    m_nodes++;
+    if (!m_stack.isEmpty() && m_stack.last().remaining < 0)
+      m_stack.last().count++;
+    switch (info.kind) {
+      case QtRencode::KIND_LIST:
+      case QtRencode::KIND_DICT: {
+        Level level = {-1, 0, info.kind == QtRencode::KIND_DICT, start};
+        m_stack.append(level);
+        break;
+      }
+      case QtRencode::KIND_FIXED_LIST:
+      case QtRencode::KIND_FIXED_DICT: {
+        int count = info.embedded;
+        if (info.kind == QtRencode::KIND_FIXED_DICT) count *= 2;
+        if (count > 0) {
+          Level level = {count, 0, false, start};
+          m_stack.append(level);
+          break;
+        }
+        if (complete_element()) return Value;
+        break;
+      }
+      default:
+        if (complete_element()) return Value;
+        break;
+    }
+  }
+  return NeedMoreData;
+}
+
+QtRencodeStreamDecoder::Status QtRencodeStreamDecoder::fail(int pos) {
+  m_error = true;
+  m_scan = pos;
+  return Error;
+}
+
+/**
+ * @brief QtRencodeStreamDecoder::complete_element
+ * @return bool
+ * 一个元素结束，关闭随之结束的定长容器，顶层值完整时返回true
+ */
+bool QtRencodeStreamDecoder::complete_element() {
+  while (!m_stack.isEmpty()) {
+    int &remain = m_stack.last().remaining;
+    if (remain == -1) return false;
+    if (--remain > 0) return false;
+    m_stack.removeLast();
+  }
+  return true;
+}
+
+QtRencodeStreamEncoder::QtRencodeStreamEncoder(
+    QIODevice *device, const QtRencode::Options &options, int chunkSize)
+    : m_options(options), m_buffer(device, chunkSize), m_broken(false) {}
+
+QtRencodeStreamEncoder::~QtRencodeStreamEncoder() { m_buffer.flush(); }
+
+/**
+ * @brief QtRencodeStreamEncoder::write
+ * @param value
+ * @return bool
+ * 编码一个值，缓冲区写满的部分随即写入设备，编码或写入失败时返回false。
+ * 编码失败时撤销这个值仍在缓冲区中的数据，之后的值不受影响
+ */
+bool QtRencodeStreamEncoder::write(const QVariant &value) {
+  if (m_broken) return false;
+  qint64 start = m_buffer.size();
+  QtRencode::encode(&m_buffer, value, m_options);
+  if (m_buffer.failure() != QtRencode::NoError) {
+    if (!m_buffer.truncate(start)) {
+      m_broken = true;
+      m_buffer.truncate(m_buffer.flushedSize());
+    }
+    m_buffer.clearFailure();
+    return false;
+  }
+  return !m_buffer.hasError();
+}
+
+/**
+ * @brief QtRencodeStreamEncoder::flush
+ * @return bool
+ * 把缓冲区中剩余的数据写入设备
+ */
+bool QtRencodeStreamEncoder::flush() { return !m_broken && m_buffer.flush(); }
+
+/**
+ * @brief QtRencodeStreamEncoder::bytesWritten
+ * @return qint64
+ * 已写入设备的字节数，不含缓冲区中尚未写出的数据
+ */
+qint64 QtRencodeStreamEncoder::bytesWritten() const {
+  return m_buffer.flushedSize();
+}
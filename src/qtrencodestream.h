@@ -0,0 +1,103 @@
+﻿#ifndef QTRENCODESTREAM_H
+#define QTRENCODESTREAM_H
+
+#pragma once
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QVariant>
+#include <QVector>
+
+#include "qtrencode.h"
+
+/**
+ * @brief The QtRencodeStreamDecoder class
+ * 增量解码器，可分块喂入数据（如QTcpSocket、QLocalSocket收到的数据），
+ * 每个完整的顶层值一到齐就能取出。已经扫描过的字节不会重复扫描，
+ * 只有完整的值才会被解码一次。扫描时即按Limits检查字符串的声明长度、
+ * 嵌套层数、容器元素个数和值的个数，超出时立即报错，不再缓冲数据
+ */
+class QtRencodeStreamDecoder {
+ public:
+  enum Status {
+    // 数据不足，需要继续喂入
+    NeedMoreData,
+    // 取出了一个完整的值
+    Value,
+    // 数据格式错误，需要reset()后才能继续使用
+    Error
+  };
+
+  explicit QtRencodeStreamDecoder(
+      const QtRencode::Options &options = QtRencode::Options(),
+      const QtRencode::Limits &limits = QtRencode::Limits());
+
+  void feed(const QByteArray &data);
+  qint64 feed(QIODevice *device);
+  Status next(QVariant *value);
+  void reset();
+
+  int bufferedSize() const;
+  qint64 errorOffset() const;
+
+ private:
+  Q_DISABLE_COPY(QtRencodeStreamDecoder)
+  // 未闭合的容器
+  struct Level {
+    // 定长容器剩余的元素个数，以CHR_TERM结束的容器为-1
+    int remaining;
+    // 以CHR_TERM结束的容器已有的元素个数，字典的键和值分别计数
+    int count;
+    bool dict;
+    // 容器在整个数据流中的偏移
+    qint64 start;
+  };
+
+  Status scan();
+  Status fail(int pos);
+  bool complete_element();
+
+  QtRencode::Options m_options;
+  QtRencode::Limits m_limits;
+  QByteArray m_buffer;
+  // 当前顶层值在m_buffer中的起始位置
+  int m_start;
+  // 已扫描到的位置
+  int m_scan;
+  QVector<Level> m_stack;
+  // 当前顶层值中已扫描的值的个数
+  qint64 m_nodes;
+  // 已丢弃的字节数，用于换算错误位置
+  qint64 m_consumed;
+  bool m_error;
+};
+
+/**
+ * @brief The QtRencodeStreamEncoder class
+ * 流式编码器，把值依次编码后写入QIODevice（QFile、QTcpSocket、QBuffer等）。
+ * 内部缓冲区大小固定，写满一块才调用一次write，多个小值合并写出，
+ * 超大列表编码时内存占用也保持不变。编码失败的值不会写出；
+ * 若其部分数据已经写入设备，流已损坏，之后的write和flush都返回false
+ */
+class QtRencodeStreamEncoder {
+ public:
+  explicit QtRencodeStreamEncoder(
+      QIODevice *device,
+      const QtRencode::Options &options = QtRencode::Options(),
+      int chunkSize = QtRencode::DEFAULT_CHUNK_SIZE);
+  ~QtRencodeStreamEncoder();
+
+  bool write(const QVariant &value);
+  bool flush();
+  qint64 bytesWritten() const;
+
+ private:
+  Q_DISABLE_COPY(QtRencodeStreamEncoder)
+
+  QtRencode::Options m_options;
+  QtRencodeBuffer m_buffer;
+  // 设备中有编码失败的值的部分数据
+  bool m_broken;
+};
+
+#endif  // QTRENCODESTREAM_H
@@ -0,0 +1,173 @@
+﻿#include "qtrencodetree.h"
+
+QtRencodeTree::QtRencodeTree() : m_count(0), m_used(0) {}
+
+/**
+ * @brief QtRencodeTree::parse
+ * @param data
+ * @return bool
+ * 解码一个完整的值，之前的节点全部作废。数据格式错误或有多余数据时返回false
+ */
+bool QtRencodeTree::parse(const QByteArray &data) {
+  clear();
+  unsigned int pos = 0;
+  bool ok = QtRencode::parse(data, this, &pos) &&
+            pos == (unsigned int)data.size() && m_stack.isEmpty();
+  if (!ok) clear();
+  return ok;
+}
+
+/**
+ * @brief QtRencodeTree::clear
+ * 丢弃全部节点，只重置计数，保留已分配的内存
+ */
+void QtRencodeTree::clear() {
+  m_count = 0;
+  m_used = 0;
+  m_stack.clear();
+}
+
+QtRencodeTree::Type QtRencodeTree::type(int node) const {
+  if (node < 0 || node >= m_count) return Invalid;
+  return Type(m_nodes.at(node).type);
+}
+
+int QtRencodeTree::size(int node) const {
+  Type t = type(node);
+  return t == String || t == List || t == Dict ? m_nodes.at(node).size : 0;
+}
+
+/**
+ * @brief QtRencodeTree::end
+ * @param node
+ * @return int
+ * 子树之后的下一个节点的下标。容器node的子节点依次为
+ * node + 1, end(node + 1), ...，直到等于end(node)为止；字典中键和值交替出现
+ */
+int QtRencodeTree::end(int node) const {
+  if (type(node) == Invalid) return -1;
+  return m_nodes.at(node).end;
+}
+
+int QtRencodeTree::child(int node, int i) const {
+  Type t = type(node);
+  int count = t == Dict ? size(node) * 2 : size(node);
+  if ((t != List && t != Dict) || i < 0 || i >= count) return -1;
+  int c = node + 1;
+  for (; i > 0; i--) c = m_nodes.at(c).end;
+  return c;
+}
+
+/**
+ * @brief QtRencodeTree::value
+ * @param dict
+ * @param key
+ * @return int
+ * 字典中字符串键key对应的值节点，没有时返回-1
+ */
+int QtRencodeTree::value(int dict, const QByteArray &key) const {
+  if (type(dict) != Dict) return -1;
+  const Node &node = m_nodes.at(dict);
+  for (int k = dict + 1; k < node.end;) {
+    int v = m_nodes.at(k).end;
+    if (m_nodes.at(k).type == String && toBytes(k) == key) return v;
+    k = m_nodes.at(v).end;
+  }
+  return -1;
+}
+
+bool QtRencodeTree::toBool(int node) const {
+  return type(node) == Bool && m_nodes.at(node).b;
+}
+
+qint64 QtRencodeTree::toInt(int node) const {
+  Type t = type(node);
+  if (t == Int) return m_nodes.at(node).i;
+  if (t == Float) return qint64(m_nodes.at(node).d);
+  return 0;
+}
+
+double QtRencodeTree::toDouble(int node) const {
+  Type t = type(node);
+  if (t == Float) return m_nodes.at(node).d;
+  if (t == Int) return double(m_nodes.at(node).i);
+  return 0;
+}
+
+QByteArray QtRencodeTree::toBytes(int node) const {
+  if (type(node) != String) return QByteArray();
+  const Node &n = m_nodes.at(node);
+  return QByteArray::fromRawData(m_bytes.constData() + n.offset, n.size);
+}
+
+QtRencodeTree::Node *QtRencodeTree::append(Type type) {
+  if (m_count == m_nodes.size()) m_nodes.resize(qMax(m_count * 2, 64));
+  // 父容器计数，字典在结束时再折算成键值对个数
+  if (!m_stack.isEmpty()) m_nodes[m_stack.last()].size++;
+  Node *node = m_nodes.data() + m_count;
+  node->type = type;
+  node->size = 0;
+  node->end = ++m_count;
+  return node;
+}
+
+bool QtRencodeTree::scalar(Type type) {
+  append(type);
+  return true;
+}
+
+bool QtRencodeTree::onNone() { return scalar(None); }
+
+bool QtRencodeTree::onBool(bool value) {
+  append(Bool)->b = value;
+  return true;
+}
+
+bool QtRencodeTree::onInt(qint64 value) {
+  append(Int)->i = value;
+  return true;
+}
+
+bool QtRencodeTree::onFloat(double value) {
+  append(Float)->d = value;
+  return true;
+}
+
+bool QtRencodeTree::onString(const QByteArray &value) {
+  if (m_used + value.size() > m_bytes.size())
+    m_bytes.resize(qMax(m_bytes.size() * 2, m_used + value.size()));
+  Node *node = append(String);
+  node->size = value.size();
+  node->offset = m_used;
+  memcpy(m_bytes.data() + m_used, value.constData(), value.size());
+  m_used += value.size();
+  return true;
+}
+
+bool QtRencodeTree::beginList(int) {
+  append(List);
+  m_stack.append(m_count - 1);
+  return true;
+}
+
+bool QtRencodeTree::endList() {
+  m_nodes[m_stack.last()].end = m_count;
+  m_stack.removeLast();
+  return true;
+}
+
+bool QtRencodeTree::beginDict(int) {
+  append(Dict);
+  m_stack.append(m_count - 1);
+  return true;
+}
+
+bool QtRencodeTree::key(const QByteArray &key) { return onString(key); }
+
+bool QtRencodeTree::endDict() {
+  Node &node = m_nodes[m_stack.last()];
+  node.size /= 2;
+  node.end = m_count;
+  m_stack.removeLast();
+  return true;
+}
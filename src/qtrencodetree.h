@@ -0,0 +1,85 @@
+﻿#ifndef QTRENCODETREE_H
+#define QTRENCODETREE_H
+
+#pragma once
+
+#include <QByteArray>
+#include <QVarLengthArray>
+#include <QVector>
+
+#include "qtrencode.h"
+
+/**
+ * @brief The QtRencodeTree class
+ * 解码结果的紧凑表示。全部节点按先序存放在一个数组中，全部字符串字节存放在
+ * 另一块连续内存中，两者都只追加不单独释放。容器的子节点紧跟在容器之后，
+ * 每个节点记录其子树之后的下标，因此遍历子节点不需要额外的指针。
+ * clear()和再次parse()只重置计数、保留已分配的内存，
+ * 同一个对象反复解码小消息时不再调用malloc/free。
+ * 节点以下标表示，toBytes()返回的字节串在下一次parse()或clear()前有效
+ */
+class QtRencodeTree : private QtRencodeVisitor {
+ public:
+  enum Type { Invalid, None, Bool, Int, Float, String, List, Dict };
+
+  QtRencodeTree();
+
+  bool parse(const QByteArray &data);
+  void clear();
+
+  int nodeCount() const { return m_count; }
+  // 根节点的下标，没有数据时为-1
+  int root() const { return m_count > 0 ? 0 : -1; }
+
+  Type type(int node) const;
+  // 列表的元素个数、字典的键值对个数或字符串的字节数
+  int size(int node) const;
+  int end(int node) const;
+  int child(int node, int i) const;
+  int value(int dict, const QByteArray &key) const;
+
+  bool toBool(int node) const;
+  qint64 toInt(int node) const;
+  double toDouble(int node) const;
+  QByteArray toBytes(int node) const;
+
+ private:
+  Q_DISABLE_COPY(QtRencodeTree)
+
+  struct Node {
+    quint8 type;
+    int size;
+    // 子树之后的下一个节点的下标
+    int end;
+    union {
+      bool b;
+      qint64 i;
+      double d;
+      // 字符串在m_bytes中的偏移
+      int offset;
+    };
+  };
+
+  Node *append(Type type);
+  bool scalar(Type type);
+
+  bool onNone() override;
+  bool onBool(bool value) override;
+  bool onInt(qint64 value) override;
+  bool onFloat(double value) override;
+  bool onString(const QByteArray &value) override;
+  bool beginList(int size) override;
+  bool endList() override;
+  bool beginDict(int size) override;
+  bool key(const QByteArray &key) override;
+  bool endDict() override;
+
+  QVector<Node> m_nodes;
+  int m_count;
+  QByteArray m_bytes;
+  int m_used;
+  // 尚未结束的容器
+  QVarLengthArray<int, 64> m_stack;
+};
+
+#endif  // QTRENCODETREE_H
@@ -13,6 +13,10 @@ CONFIG += exceptions
 # deprecated API in order to know how to port your code away from it.
 DEFINES += QT_DEPRECATED_WARNINGS
 DEFINES += QT_NO_DEBUG_OUTPUT QT_NO_DEBUG
+# The codec trace points can be hooked at runtime with
+# QtRencode::setTraceHandler(). Defining QTRENCODE_NO_TRACE removes them at
+# compile time.
+# DEFINES += QTRENCODE_NO_TRACE
 
 # You can also make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
@@ -20,10 +24,26 @@ DEFINES += QT_NO_DEBUG_OUTPUT QT_NO_DEBUG
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
-    qtrencode.cpp
+    qtrencode.cpp \
+    qtrencodebyteorder.cpp \
+    qtrencodedocument.cpp \
+    qtrencodekeycache.cpp \
+    qtrencodelog.cpp \
+    qtrencodemappedfile.cpp \
+    qtrencodeparallel.cpp \
+    qtrencodestream.cpp \
+    qtrencodetree.cpp
 
 HEADERS += \
-    qtrencode.h
+    qtrencode.h \
+    qtrencodebyteorder.h \
+    qtrencodedocument.h \
+    qtrencodekeycache.h \
+    qtrencodelog.h \
+    qtrencodemappedfile.h \
+    qtrencodeparallel.h \
+    qtrencodestream.h \
+    qtrencodetree.h
 
 # Default rules for deployment.
 unix {
@@ -12,7 +12,23 @@ TEMPLATE = app
 INCLUDEPATH += $$PWD/../src
 
 SOURCES +=  tst_testqtrencode.cpp \
-    ../src/qtrencode.cpp
+    ../src/qtrencode.cpp \
+    ../src/qtrencodebyteorder.cpp \
+    ../src/qtrencodedocument.cpp \
+    ../src/qtrencodekeycache.cpp \
+    ../src/qtrencodelog.cpp \
+    ../src/qtrencodemappedfile.cpp \
+    ../src/qtrencodeparallel.cpp \
+    ../src/qtrencodestream.cpp \
+    ../src/qtrencodetree.cpp
 
 HEADERS += \
-    ../src/qtrencode.h
+    ../src/qtrencode.h \
+    ../src/qtrencodebyteorder.h \
+    ../src/qtrencodedocument.h \
+    ../src/qtrencodekeycache.h \
+    ../src/qtrencodelog.h \
+    ../src/qtrencodemappedfile.h \
+    ../src/qtrencodeparallel.h \
+    ../src/qtrencodestream.h \
+    ../src/qtrencodetree.h
@@ -1,5 +1,13 @@
 ﻿#include <QtTest>
 #include "qtrencode.h"
+#include "qtrencodebyteorder.h"
+#include "qtrencodedocument.h"
+#include "qtrencodekeycache.h"
+#include "qtrencodelog.h"
+#include "qtrencodemappedfile.h"
+#include "qtrencodeparallel.h"
+#include "qtrencodestream.h"
+#include "qtrencodetree.h"
 
 class TestQtRencode : public QObject {
   Q_OBJECT
@@ -10,8 +18,117 @@ class TestQtRencode : public QObject {
 
  private slots:
   void test_case1();
+  void test_options();
+  void test_trace();
+  void test_nested();
+  void test_zero_copy();
+  void test_visitor();
+  void test_stream_decoder();
+  void test_stream_encoder();
+  void test_json();
+  void test_typed_arrays();
+  void test_byte_order();
+  void test_encode_into();
+  void test_segments();
+  void test_tree();
+  void test_document();
+  void test_validate();
+  void test_limits();
+  void test_result();
+  void test_batch();
+  void test_parallel_decode();
+  void test_parallel_encode();
+  void test_mapped_file();
+  void test_log();
+  void test_key_cache();
 };
 
+class NameVisitor : public QtRencodeVisitor {
+ public:
+  NameVisitor() : ints(0), found(false) {}
+  bool onInt(qint64) override {
+    ints++;
+    return true;
+  }
+  bool key(const QByteArray &key) override {
+    found = key == "name";
+    return true;
+  }
+  bool onString(const QByteArray &value) override {
+    if (!found) return true;
+    name = value;
+    return false;
+  }
+
+  int ints;
+  bool found;
+  QByteArray name;
+};
+
+// 在线程池的工作线程中并行解码
+class ParallelLoadsTask : public QRunnable {
+ public:
+  ParallelLoadsTask(const QByteArray &data, QThreadPool *pool)
+      : data(data), pool(pool) {
+    setAutoDelete(false);
+  }
+  void run() override {
+    QtRencodeParallel::loads(data, &value, QtRencode::Options(),
+                             QtRencode::Limits(), pool);
+  }
+
+  QByteArray data;
+  QThreadPool *pool;
+  QVariant value;
+};
+
+// 在线程池的工作线程中并行编码
+class ParallelDumpsTask : public QRunnable {
+ public:
+  ParallelDumpsTask(const QVariant &value, QThreadPool *pool)
+      : value(value), pool(pool) {
+    setAutoDelete(false);
+  }
+  void run() override {
+    QtRencodeParallel::dumps(value, &data, QtRencode::Options(), pool);
+  }
+
+  QVariant value;
+  QThreadPool *pool;
+  QByteArray data;
+};
+
+static QList<quint8> trace_typecodes;
+
+static void record_trace(const char *, quint8 typecode, quint32, quint32) {
+  trace_typecodes.append(typecode);
+}
+
+// 只有一条记录的日志，索引帧在偏移14处，其内容由参数给出
+static QByteArray indexed_log(quint64 prev, quint32 n, quint64 entry) {
+  char be[8];
+  QByteArray data("QRLG\0\0\0\1", QtRencodeLog::FILE_HEADER_SIZE);
+  data += QtRencodeLog::FRAME_RECORD;
+  qToBigEndian<quint32>(1, be);
+  data.append(be, 4);
+  data += QtRencode::dumps(QVariant(7));
+  data += QtRencodeLog::FRAME_INDEX;
+  qToBigEndian<quint32>(12 + n * 8, be);
+  data.append(be, 4);
+  qToBigEndian<quint64>(prev, be);
+  data.append(be, 8);
+  qToBigEndian<quint32>(n, be);
+  data.append(be, 4);
+  qToBigEndian<quint64>(entry, be);
+  data.append(be, n * 8);
+  qToBigEndian<quint64>(14, be);
+  data.append(be, 8);
+  qToBigEndian<quint64>(1, be);
+  data.append(be, 8);
+  data += QtRencodeLog::footerMagic();
+  return data;
+}
+
 TestQtRencode::TestQtRencode() {}
 
 TestQtRencode::~TestQtRencode() {}
@@ -61,6 +178,797 @@ void TestQtRencode::test_case1() {
   qInfo() << QtRencode::loads(QByteArray(";"), false);
 }
 
+void TestQtRencode::test_options() {
+  QtRencode::Options options;
+  options.floatBits = 64;
+  QByteArray result = QtRencode::dumps(QVariant(1.5), options);
+  QCOMPARE(result.size(), 9);
+  QCOMPARE(result.at(0), char(44));
+
+  options.useJson = false;
+  QVariant tmp = QtRencode::loads(QtRencode::dumps(QVariant("ab")), options);
+  QCOMPARE(tmp.type(), QVariant::ByteArray);
+  QCOMPARE(tmp.toByteArray(), QByteArray("ab"));
+}
+
+void TestQtRencode::test_trace() {
+  trace_typecodes.clear();
+  QtRencode::setTraceHandler(record_trace);
+  QByteArray result = QtRencode::dumps(QVariant(QVariantList() << 1 << "a"));
+  QtRencode::loads(result);
+  QtRencode::setTraceHandler(NULL);
+#ifndef QTRENCODE_NO_TRACE
+  QCOMPARE(trace_typecodes.size(), 6);
+  QCOMPARE(trace_typecodes.first(), quint8(194));
+#endif
+}
+
+void TestQtRencode::test_nested() {
+  QVariantList inner;
+  for (int i = 0; i < 100; i++) inner.append(i * 1000);
+  QVariantMap map;
+  map.insert("list", inner);
+  map.insert("str", QString(300, 'x'));
+  QVariantList outer;
+  for (int i = 0; i < 10; i++) outer = QVariantList() << outer << map;
+  QByteArray result = QtRencode::dumps(QVariant(outer));
+  QCOMPARE(QtRencode::loads(result), QVariant(outer));
+
+  // 截断的数据不能越界读取
+  result.chop(1);
+  QtRencode::loads(result);
+}
+
+void TestQtRencode::test_zero_copy() {
+  QtRencode::Options options;
+  options.useJson = false;
+  options.zeroCopy = true;
+  QByteArray blob(1000, 'b');
+  QByteArray result = QtRencode::dumps(QVariant(QVariantList() << blob));
+  QVariantList tmp = QtRencode::loads(result, options).toList();
+  QCOMPARE(tmp.size(), 1);
+  QCOMPARE(tmp.at(0).toByteArray(), blob);
+  QVERIFY(tmp.at(0).toByteArray().constData() > result.constData());
+  QVERIFY(tmp.at(0).toByteArray().constData() <
+          result.constData() + result.size());
+}
+
+void TestQtRencode::test_visitor() {
+  QVariantMap map;
+  map.insert("name", "irony");
+  QVariantList list;
+  list << "configure-window" << 1 << 242 << map << 0;
+  QByteArray result = QtRencode::dumps(QVariant(list));
+
+  NameVisitor visitor;
+  QVERIFY(QtRencode::parse(result, &visitor));
+  QCOMPARE(visitor.name, QByteArray("irony"));
+  QCOMPARE(visitor.ints, 2);
+
+  QVERIFY(!QtRencode::parse(result.left(5), &visitor));
+
+  // 嵌套过深的数据报错而不是耗尽栈空间
+  QByteArray nested(1000000, char(59));
+  QVERIFY(!QtRencode::parse(nested, &visitor));
+  QVERIFY(QtRencode::toJson(nested).isEmpty());
+  nested = QByteArray(3, char(59)) + QByteArray(3, char(127));
+  QVERIFY(QtRencode::parse(nested, &visitor, NULL, 3));
+  QVERIFY(!QtRencode::parse(nested, &visitor, NULL, 2));
+}
+
+void TestQtRencode::test_stream_decoder() {
+  QVariantList list;
+  for (int i = 0; i < 70; i++) list << i << QString(i, 'x');
+  QVariantMap map;
+  map.insert("list", list);
+  QByteArray stream = QtRencode::dumps(QVariant(list)) +
+                      QtRencode::dumps(QVariant(map)) +
+                      QtRencode::dumps(QVariant(123456789));
+
+  QtRencodeStreamDecoder decoder;
+  QVariantList values;
+  QVariant value;
+  for (int i = 0; i < stream.size(); i++) {
+    decoder.feed(stream.mid(i, 1));
+    QtRencodeStreamDecoder::Status status;
+    while ((status = decoder.next(&value)) == QtRencodeStreamDecoder::Value)
+      values.append(value);
+    QCOMPARE(status, QtRencodeStreamDecoder::NeedMoreData);
+  }
+  QCOMPARE(values.size(), 3);
+  QCOMPARE(values.at(0), QVariant(list));
+  QCOMPARE(values.at(1), QVariant(map));
+  QCOMPARE(values.at(2).toInt(), 123456789);
+  QCOMPARE(decoder.bufferedSize(), 0);
+
+  decoder.feed(QByteArray(1, char(127)));
+  QCOMPARE(decoder.next(&value), QtRencodeStreamDecoder::Error);
+
+  // 上限在数据到齐之前就生效
+  QtRencode::Limits limits;
+  limits.maxStringLength = 1000;
+  QtRencodeStreamDecoder strings(QtRencode::Options(), limits);
+  strings.feed(QByteArray("999999999:"));
+  QCOMPARE(strings.next(&value), QtRencodeStreamDecoder::Error);
+  QCOMPARE(strings.errorOffset(), qint64(0));
+
+  QtRencodeStreamDecoder nested;
+  nested.feed(QByteArray(600, char(59)));
+  QCOMPARE(nested.next(&value), QtRencodeStreamDecoder::Error);
+  QCOMPARE(nested.errorOffset(), qint64(QtRencode::Limits().maxDepth));
+
+  limits = QtRencode::Limits();
+  limits.maxContainerSize = 10;
+  QByteArray terminated = QtRencode::dumps(QVariant(list));
+  QtRencodeStreamDecoder containers(QtRencode::Options(), limits);
+  containers.feed(QByteArray(1, char(59)));
+  containers.feed(terminated.left(terminated.size() / 2));
+  QCOMPARE(containers.next(&value), QtRencodeStreamDecoder::Error);
+  QVariant loaded;
+  QtRencode::Result result =
+      QtRencode::loads(QByteArray(1, char(59)) + terminated, &loaded,
+                       QtRencode::Options(), limits);
+  QCOMPARE(result.error, QtRencode::ContainerLimitExceeded);
+  QCOMPARE(containers.errorOffset(), result.offset);
+}
+
+void TestQtRencode::test_stream_encoder() {
+  QVariantList list;
+  for (int i = 0; i < 1000; i++) list << i << QString(i % 100, 'x');
+  QByteArray blob(5000, 'b');
+  QByteArray expected =
+      QtRencode::dumps(QVariant(list)) + QtRencode::dumps(QVariant(blob));
+
+  QBuffer device;
+  device.open(QIODevice::WriteOnly);
+  {
+    QtRencodeStreamEncoder encoder(&device, QtRencode::Options(), 256);
+    QVERIFY(encoder.write(list));
+    QVERIFY(encoder.write(blob));
+    QVERIFY(encoder.flush());
+    QCOMPARE(encoder.bytesWritten(), qint64(expected.size()));
+  }
+  QCOMPARE(device.data(), expected);
+
+  // 编码失败的值被撤销，不影响前后的值
+  QtRencode::Options invalid;
+  invalid.floatBits = 16;
+  QBuffer skipped;
+  skipped.open(QIODevice::WriteOnly);
+  {
+    QtRencodeStreamEncoder encoder(&skipped, invalid, 256);
+    QVERIFY(encoder.write(list));
+    QVERIFY(encoder.flush());
+    QVERIFY(!encoder.write(QVariantList() << 1 << 0.5));
+    QVERIFY(encoder.write(blob));
+  }
+  QCOMPARE(skipped.data(), expected);
+
+  // 失败的值已有部分写入设备时，之后不再写入
+  QBuffer broken;
+  broken.open(QIODevice::WriteOnly);
+  {
+    QtRencodeStreamEncoder encoder(&broken, invalid, 256);
+    QVERIFY(!encoder.write(QVariantList() << blob << 0.5));
+    QVERIFY(!encoder.write(list));
+    QVERIFY(!encoder.flush());
+  }
+  // 列表头、长度前缀"5000:"和直接写出的字节串
+  QCOMPARE(broken.data().size(), 1 + 5 + blob.size());
+
+  QBuffer single;
+  single.open(QIODevice::WriteOnly);
+  QVERIFY(QtRencode::dump(&single, list));
+  QCOMPARE(single.data(), QtRencode::dumps(QVariant(list)));
+
+  QVERIFY(!QtRencode::dump(&single, QVariant(0.5), invalid));
+}
+
+void TestQtRencode::test_json() {
+  QByteArray json(
+      "[1, -70000, 2.5, \"a\\n\\u00e9\", {\"b\": null, \"a\": true}, []]");
+  QByteArray data = QtRencode::fromJson(json);
+  QCOMPARE(QtRencode::toJson(data),
+           QByteArray("[1,-70000,2.5,\"a\\n\xc3\xa9\","
+                      "{\"b\":null,\"a\":true},[]]"));
+  QVariantList list = QtRencode::loads(data).toList();
+  QCOMPARE(list.at(0).toInt(), 1);
+  QCOMPARE(list.at(3).toString(), QString::fromUtf8("a\n\xc3\xa9"));
+
+  QVariantList ints;
+  QByteArray array("[");
+  for (int i = 0; i < 100; i++) {
+    ints << i * 1000;
+    array += (i ? "," : "") + QByteArray::number(i * 1000);
+  }
+  array += "]";
+  QCOMPARE(QtRencode::fromJson(array), QtRencode::dumps(QVariant(ints)));
+
+  int offset;
+  QVERIFY(QtRencode::fromJson("[1,]", QtRencode::Options(), &offset).isEmpty());
+  QCOMPARE(offset, 3);
+
+  // dumps(json)的输出不变，仍经过QJsonDocument
+  QByteArray object("{\"b\": 1, \"a\": [2]}");
+  QCOMPARE(QtRencode::dumps(object),
+           QtRencode::dumps(QJsonDocument::fromJson(object)));
+  QVERIFY(QtRencode::dumps(object) != QtRencode::fromJson(object));
+}
+
+void TestQtRencode::test_typed_arrays() {
+  QVector<qint32> ints;
+  QVariantList list;
+  for (int i = 0; i < 200; i++) {
+    qint32 v = (i % 2 ? -1 : 1) * i * i * i * 37;
+    ints << v;
+    list << v;
+  }
+  QByteArray data = QtRencode::dumps(ints);
+  QCOMPARE(data, QtRencode::dumps(QVariant(list)));
+  QVector<qint32> decoded;
+  QVERIFY(QtRencode::loads(data, &decoded));
+  QCOMPARE(decoded, ints);
+
+  std::vector<double> doubles = {0.5, -1e300, 3.25};
+  QtRencode::Options options;
+  options.floatBits = 64;
+  data = QtRencode::dumps(doubles);
+  QCOMPARE(data, QtRencode::dumps(QVariant(QVariantList() << 0.5 << -1e300
+                                                         << 3.25),
+                                  options));
+  std::vector<double> decodedDoubles;
+  QVERIFY(QtRencode::loads(data, &decodedDoubles));
+  QVERIFY(decodedDoubles == doubles);
+
+  QVERIFY(!QtRencode::loads(data, &decoded));
+  QVector<float> halves(3, 0.5f);
+  options.floatBits = 32;
+  QCOMPARE(QtRencode::dumps(halves),
+           QtRencode::dumps(QVariant(QVariantList() << 0.5 << 0.5 << 0.5),
+                            options));
+  QVector<float> floats;
+  QVERIFY(QtRencode::loads(QtRencode::dumps(ints), &floats));
+  QCOMPARE(floats.size(), ints.size());
+}
+
+void TestQtRencode::test_byte_order() {
+  qInfo() << QtRencodeByteOrder::kernel();
+  QVector<quint64> values;
+  for (int i = 0; i < 37; i++) values << Q_UINT64_C(0x0102030405060708) * i;
+  QVector<quint64> swapped(values.size());
+  QtRencodeByteOrder::swap64(values.constData(), swapped.data(), values.size());
+  for (int i = 0; i < values.size(); i++)
+    QCOMPARE(swapped.at(i), qbswap(values.at(i)));
+
+  QVector<double> doubles;
+  QVariantList list;
+  for (int i = 0; i < 1000; i++) {
+    doubles << i / 3.0;
+    list << i / 3.0;
+  }
+  QtRencode::Options options;
+  options.floatBits = 64;
+  QByteArray data = QtRencode::dumps(doubles);
+  QCOMPARE(data, QtRencode::dumps(QVariant(list), options));
+  QVector<double> decoded;
+  QVERIFY(QtRencode::loads(data, &decoded));
+  QCOMPARE(decoded, doubles);
+}
+
+void TestQtRencode::test_encode_into() {
+  QVariantMap map;
+  map.insert("id", 70000);
+  map.insert("name", QString(100, 'n'));
+  map.insert("values", QVariantList() << 1 << -5 << 2.5 << QVariant());
+  QVariant value = QVariantList() << map << QByteArray(1000, 'x') << true;
+  QByteArray expected = QtRencode::dumps(value);
+
+  QCOMPARE(QtRencode::encodedSize(value), qint64(expected.size()));
+  QByteArray out(expected.size(), '\0');
+  QCOMPARE(QtRencode::encodeInto(out.data(), out.size(), value),
+           qint64(expected.size()));
+  QCOMPARE(out, expected);
+
+  char small[16];
+  QCOMPARE(QtRencode::encodeInto(small, sizeof(small), value),
+           qint64(expected.size()));
+
+  // 编码出错时返回-1，而不是截断后的长度
+  QtRencode::Options invalid;
+  invalid.floatBits = 16;
+  QCOMPARE(QtRencode::encodedSize(value, invalid), qint64(-1));
+  QCOMPARE(QtRencode::encodeInto(out.data(), out.size(), value, invalid),
+           qint64(-1));
+}
+
+void TestQtRencode::test_segments() {
+  QByteArray blob(10000, 'b');
+  QVariant value = QVariantList() << 1 << blob << "tail";
+  QtRencodeSegments segments;
+  QCOMPARE(QtRencode::encodeSegments(value, &segments),
+           qint64(QtRencode::dumps(value).size()));
+  QCOMPARE(segments.join(), QtRencode::dumps(value));
+  QCOMPARE(segments.count(), 3);
+  // 长字节串引用原数据，没有复制
+  QVERIFY(segments.data(1) == blob.constData());
+  QCOMPARE(segments.size(1), blob.size());
+
+  QtRencode::Options invalid;
+  invalid.floatBits = 16;
+  QCOMPARE(QtRencode::encodeSegments(QVariantList() << blob << 0.5, &segments,
+                                     invalid),
+           qint64(-1));
+  QCOMPARE(segments.count(), 0);
+}
+
+void TestQtRencode::test_tree() {
+  QVariantMap map;
+  map.insert("id", 7);
+  map.insert("name", "irony");
+  QVariant value = QVariantList() << "configure-window" << 667.25 << map
+                                  << QVariantList();
+  QByteArray data = QtRencode::dumps(value);
+
+  QtRencodeTree tree;
+  QVERIFY(tree.parse(data));
+  int root = tree.root();
+  QCOMPARE(tree.type(root), QtRencodeTree::List);
+  QCOMPARE(tree.size(root), 4);
+  QCOMPARE(tree.end(root), tree.nodeCount());
+  QCOMPARE(tree.toBytes(tree.child(root, 0)), QByteArray("configure-window"));
+  QCOMPARE(tree.toDouble(tree.child(root, 1)), 667.25);
+  int dict = tree.child(root, 2);
+  QCOMPARE(tree.type(dict), QtRencodeTree::Dict);
+  QCOMPARE(tree.size(dict), 2);
+  QCOMPARE(tree.toInt(tree.value(dict, "id")), qint64(7));
+  QCOMPARE(tree.toBytes(tree.value(dict, "name")), QByteArray("irony"));
+  QCOMPARE(tree.value(dict, "missing"), -1);
+  QCOMPARE(tree.size(tree.child(root, 3)), 0);
+
+  QVERIFY(!tree.parse(data.left(data.size() - 1)));
+  QVERIFY(tree.parse(QtRencode::dumps(QVariant(5))));
+  QCOMPARE(tree.toInt(tree.root()), qint64(5));
+}
+
+void TestQtRencode::test_document() {
+  QVariantMap header;
+  header.insert("id", 42);
+  header.insert("route", "cmd");
+  QVariantList samples;
+  for (int i = 0; i < 100; i++) samples << i;
+  QByteArray data =
+      QtRencode::dumps(QVariant(QVariantList() << header << samples << "tail"));
+
+  QtRencodeDocument doc(data);
+  QCOMPARE(doc.type(), QtRencodeDocument::List);
+  QCOMPARE(doc.size(), 3);
+  QtRencodeDocument first = doc.at(0);
+  QCOMPARE(first.type(), QtRencodeDocument::Dict);
+  QCOMPARE(first.value("route").toBytes(), QByteArray("cmd"));
+  QCOMPARE(first.value("id").toInt(), qint64(42));
+  QVERIFY(!first.value("missing").isValid());
+
+  QtRencodeDocument list = doc.at(1);
+  QCOMPARE(list.size(), 100);
+  QCOMPARE(list.at(99).toInt(), qint64(99));
+  QVERIFY(!list.at(100).isValid());
+  QCOMPARE(list.toVariant().toList().size(), 100);
+  QCOMPARE(doc.at(2).toBytes(), QByteArray("tail"));
+
+  QtRencodeDocument truncated(data.left(data.size() - 3));
+  QVERIFY(truncated.at(0).isValid());
+  QVERIFY(!truncated.at(2).isValid());
+}
+
+void TestQtRencode::test_validate() {
+  QVariantList samples;
+  for (int i = 0; i < 100; i++) samples << i;
+  QByteArray data = QtRencode::dumps(
+      QVariant(QVariantList() << QByteArray(300, 's') << samples << 1.5));
+  QtRencode::Result result = QtRencode::validate(data);
+  QVERIFY(result.ok());
+  QCOMPARE(result.offset, qint64(-1));
+  QCOMPARE(QtRencode::skipValue(data), qint64(data.size()));
+  QCOMPARE(QtRencode::skipValue(data + data), qint64(data.size()));
+  QCOMPARE(QtRencode::skipValue(data.left(data.size() - 1)), qint64(-1));
+  QCOMPARE(QtRencode::skipValue(data, 0, &result), qint64(data.size()));
+  QVERIFY(result.ok());
+  // 出错的原因和位置与validate相同
+  QCOMPARE(QtRencode::skipValue(data.left(data.size() - 1), 0, &result),
+           qint64(-1));
+  QCOMPARE(result.error, QtRencode::TruncatedData);
+  QCOMPARE(result.offset,
+           QtRencode::validate(data.left(data.size() - 1)).offset);
+  QCOMPARE(QtRencode::skipValue(QByteArray(1, char(127)), 0, &result),
+           qint64(-1));
+  QCOMPARE(result.error, QtRencode::InvalidTypecode);
+  QCOMPARE(result.offset, qint64(0));
+  QCOMPARE(result.typecode, quint8(127));
+  QCOMPARE(QtRencode::validate(data.left(data.size() - 1)).error,
+           QtRencode::TruncatedData);
+  // 尾部多余的数据
+  result = QtRencode::validate(data + 'x');
+  QCOMPARE(result.error, QtRencode::MalformedData);
+  QCOMPARE(result.offset, qint64(data.size()));
+
+  // 报告的错误与按同样上限解码时相同
+  QtRencode::Limits limits;
+  limits.maxStringLength = 299;
+  QVariant decoded;
+  result = QtRencode::validate(data, limits);
+  QCOMPARE(result.error, QtRencode::StringLimitExceeded);
+  QCOMPARE(result.offset,
+           QtRencode::loads(data, &decoded, QtRencode::Options(), limits)
+               .offset);
+  limits = QtRencode::Limits();
+  limits.maxContainerSize = 99;
+  result = QtRencode::validate(data, limits);
+  QtRencode::Result decodeResult =
+      QtRencode::loads(data, &decoded, QtRencode::Options(), limits);
+  QCOMPARE(result.error, QtRencode::ContainerLimitExceeded);
+  QCOMPARE(decodeResult.error, QtRencode::ContainerLimitExceeded);
+  // 以CHR_TERM结束的列表元素过多时，位置为列表的起始位置
+  QCOMPARE(result.offset, decodeResult.offset);
+  QCOMPARE(result.typecode, decodeResult.typecode);
+  limits = QtRencode::Limits();
+  limits.maxNodes = 100;
+  QCOMPARE(QtRencode::validate(data, limits).error,
+           QtRencode::NodeLimitExceeded);
+
+  QVariant nested = 1;
+  for (int i = 0; i < 10; i++) nested = QVariantList() << nested;
+  QByteArray deep = QtRencode::dumps(nested);
+  limits = QtRencode::Limits();
+  limits.maxDepth = 10;
+  QVERIFY(QtRencode::validate(deep, limits).ok());
+  limits.maxDepth = 9;
+  QCOMPARE(QtRencode::validate(deep, limits).error,
+           QtRencode::DepthLimitExceeded);
+}
+
+void TestQtRencode::test_limits() {
+  QtRencode::Options options;
+  QtRencode::Limits limits;
+  QVariant decoded;
+  QVariant value = QVariantList() << QByteArray(100, 's') << 1 << 2 << 3;
+  QByteArray data = QtRencode::dumps(value);
+  QtRencode::Result result = QtRencode::loads(data, &decoded, options, limits);
+  QVERIFY(result.ok());
+  QCOMPARE(decoded, QtRencode::loads(data, options));
+
+  // 构造的深层嵌套不能耗尽栈
+  QByteArray deep(100000, char(59));
+  result = QtRencode::loads(deep, &decoded, options, limits);
+  QCOMPARE(result.error, QtRencode::DepthLimitExceeded);
+  QCOMPARE(result.offset, qint64(limits.maxDepth));
+  QVERIFY(!decoded.isValid());
+
+  result = QtRencode::loads(data.left(data.size() - 1), &decoded);
+  QCOMPARE(result.error, QtRencode::TruncatedData);
+  result = QtRencode::loads(QByteArray("999999999:x"), &decoded);
+  QCOMPARE(result.error, QtRencode::TruncatedData);
+
+  limits.maxStringLength = 99;
+  result = QtRencode::loads(data, &decoded, options, limits);
+  QCOMPARE(result.error, QtRencode::StringLimitExceeded);
+  QCOMPARE(result.offset, qint64(1));
+  limits = QtRencode::Limits();
+  limits.maxContainerSize = 3;
+  result = QtRencode::loads(data, &decoded, options, limits);
+  QCOMPARE(result.error, QtRencode::ContainerLimitExceeded);
+  QCOMPARE(result.offset, qint64(0));
+  limits = QtRencode::Limits();
+  limits.maxNodes = 4;
+  result = QtRencode::loads(data, &decoded, options, limits);
+  QCOMPARE(result.error, QtRencode::NodeLimitExceeded);
+}
+
+void TestQtRencode::test_result() {
+  QVariant decoded = 1;
+  // 成功解码出的None与失败可以区分
+  QtRencode::Result result =
+      QtRencode::loads(QtRencode::dumps(QVariant()), &decoded);
+  QVERIFY(result.ok());
+  QVERIFY(decoded.isNull());
+  result = QtRencode::loads(QByteArray(1, char(127)), &decoded);
+  QCOMPARE(result.error, QtRencode::InvalidTypecode);
+  QCOMPARE(result.offset, qint64(0));
+  QCOMPARE(result.typecode, quint8(127));
+  result = QtRencode::loads(QByteArray(1, char(194)) + char(1), &decoded);
+  QCOMPARE(result.error, QtRencode::TruncatedData);
+  QCOMPARE(result.offset, qint64(2));
+  QCOMPARE(result.typecode, quint8(0));
+
+  QByteArray out;
+  QVariant value = QVariantList() << 1 << "a";
+  result = QtRencode::dumps(value, &out);
+  QVERIFY(result.ok());
+  QCOMPARE(out, QtRencode::dumps(value));
+  QtRencode::Options options;
+  options.floatBits = 16;
+  result = QtRencode::dumps(QVariant(QVariantList() << 1 << 1.5), &out,
+                            options);
+  QCOMPARE(result.error, QtRencode::InvalidOption);
+  QCOMPARE(result.offset, qint64(2));
+  QVERIFY(out.isEmpty());
+}
+
+void TestQtRencode::test_batch() {
+  QVariantList values;
+  values << 1 << "frame" << QVariant() << (QVariantList() << 2 << 3.5);
+  QByteArray out;
+  QVector<int> offsets;
+  QVERIFY(QtRencode::encodeBatch(values, &out, &offsets).ok());
+  QCOMPARE(offsets.size(), values.size() + 1);
+  QCOMPARE(offsets.last(), out.size());
+  for (int i = 0; i < values.size(); i++)
+    QCOMPARE(out.mid(offsets[i], offsets[i + 1] - offsets[i]),
+             QtRencode::dumps(values.at(i)));
+
+  QVariantList decoded;
+  QVector<int> decodedOffsets;
+  QVERIFY(QtRencode::decodeBatch(out, &decoded, &decodedOffsets).ok());
+  QCOMPARE(decoded.size(), values.size());
+  QCOMPARE(decodedOffsets, offsets);
+  QCOMPARE(decoded.at(1), QVariant(QString("frame")));
+  QVERIFY(decoded.at(2).isNull());
+
+  // 出错时保留之前解码成功的值
+  decoded.clear();
+  QtRencode::Result result =
+      QtRencode::decodeBatch(out.left(out.size() - 1), &decoded);
+  QCOMPARE(result.error, QtRencode::TruncatedData);
+  QCOMPARE(decoded.size(), values.size() - 1);
+}
+
+void TestQtRencode::test_parallel_decode() {
+  QThreadPool pool;
+  pool.setMaxThreadCount(4);
+  QVariantList list;
+  for (int i = 0; i < 20000; i++)
+    list << i << QString("s%1").arg(i) << (QVariantList() << i);
+  QByteArray data = QtRencode::dumps(QVariant(list));
+  QVariant value;
+  QtRencode::Options options;
+  QVERIFY(QtRencodeParallel::loads(data, &value, options,
+                                   QtRencode::Limits(), &pool)
+              .ok());
+  QCOMPARE(value, QtRencode::loads(data, options));
+
+  // 线程池的工作线程都在调用时不会死锁
+  QThreadPool busy;
+  busy.setMaxThreadCount(2);
+  ParallelLoadsTask first(data, &busy), second(data, &busy);
+  busy.start(&first);
+  busy.start(&second);
+  QVERIFY(busy.waitForDone(60000));
+  QCOMPARE(first.value, value);
+  QCOMPARE(second.value, value);
+
+  QVariantMap map;
+  for (int i = 0; i < 10000; i++) map.insert(QString("k%1").arg(i), i);
+  data = QtRencode::dumps(QVariant(map));
+  QVERIFY(QtRencodeParallel::loads(data, &value, options,
+                                   QtRencode::Limits(), &pool)
+              .ok());
+  QCOMPARE(value.toMap(), map);
+
+  // 出错时与串行解码报告相同的错误
+  data.chop(1);
+  QtRencode::Result result = QtRencodeParallel::loads(
+      data, &value, options, QtRencode::Limits(), &pool);
+  QCOMPARE(result.error, QtRencode::loads(data, &value).error);
+  QtRencode::Limits limits;
+  limits.maxNodes = 1000;
+  result = QtRencodeParallel::loads(QtRencode::dumps(QVariant(list)), &value,
+                                    options, limits, &pool);
+  QCOMPARE(result.error, QtRencode::NodeLimitExceeded);
+}
+
+void TestQtRencode::test_parallel_encode() {
+  QThreadPool pool;
+  pool.setMaxThreadCount(4);
+  QtRencode::Options options;
+  QVariantList list;
+  for (int i = 0; i < 20000; i++)
+    list << i << QString("s%1").arg(i) << (QVariantList() << 0.5 << i);
+  QByteArray out;
+  QVERIFY(QtRencodeParallel::dumps(QVariant(list), &out, options, &pool).ok());
+  QCOMPARE(out, QtRencode::dumps(QVariant(list)));
+
+  // 线程池的工作线程都在调用时不会死锁
+  QThreadPool busy;
+  busy.setMaxThreadCount(2);
+  ParallelDumpsTask first(list, &busy), second(list, &busy);
+  busy.start(&first);
+  busy.start(&second);
+  QVERIFY(busy.waitForDone(60000));
+  QCOMPARE(first.data, out);
+  QCOMPARE(second.data, out);
+
+  QVariantMap map;
+  for (int i = 0; i < 10000; i++) map.insert(QString("k%1").arg(i), i);
+  QVERIFY(QtRencodeParallel::dumps(QVariant(map), &out, options, &pool).ok());
+  QCOMPARE(out, QtRencode::dumps(QVariant(map)));
+
+  // 出错的位置与串行编码相同
+  QVariantList ints;
+  for (int i = 0; i < 10000; i++) ints << i;
+  ints[7000] = 1.5;
+  options.floatBits = 16;
+  QtRencode::Result serial = QtRencode::dumps(QVariant(ints), &out, options);
+  QtRencode::Result result =
+      QtRencodeParallel::dumps(QVariant(ints), &out, options, &pool);
+  QCOMPARE(result.error, QtRencode::InvalidOption);
+  QCOMPARE(result.offset, serial.offset);
+  QVERIFY(out.isEmpty());
+
+  // 拼接后超出上限时与串行编码在同一位置报告OutputTooLarge
+  options = QtRencode::Options();
+  qint64 full = QtRencode::dumps(QVariant(list)).size();
+  QList<qint64> maxSizes;
+  maxSizes << full / 2 << full - 1;
+  for (qint64 maxSize : maxSizes) {
+    options.maxOutputSize = maxSize;
+    serial = QtRencode::dumps(QVariant(list), &out, options);
+    QCOMPARE(serial.error, QtRencode::OutputTooLarge);
+    result = QtRencodeParallel::dumps(QVariant(list), &out, options, &pool);
+    QCOMPARE(result.error, QtRencode::OutputTooLarge);
+    QCOMPARE(result.offset, serial.offset);
+    QVERIFY(out.isEmpty());
+  }
+}
+
+void TestQtRencode::test_mapped_file() {
+  QVariant first = QVariantList() << 1 << QByteArray(1000, 'm');
+  QVariant second = QVariantList() << "frame" << 2.5;
+  QTemporaryFile file;
+  QVERIFY(file.open());
+  file.write(QtRencode::dumps(first));
+  file.write(QtRencode::dumps(second));
+  file.write(QByteArray(1, char(194)));
+  file.flush();
+
+  QtRencodeMappedFile mapped(file.fileName());
+  QVERIFY(mapped.isOpen());
+  QCOMPARE(mapped.size(), file.size());
+  QtRencode::Options options;
+  options.useJson = false;
+  options.zeroCopy = true;
+  QVariant value;
+  QVERIFY(mapped.load(&value, options).ok());
+  // 字节串直接引用映射
+  QByteArray blob = value.toList().at(1).toByteArray();
+  QCOMPARE(blob, QByteArray(1000, 'm'));
+  QVERIFY(blob.constData() > (const char *)mapped.constData());
+  QVERIFY(blob.constData() < (const char *)mapped.constData() + mapped.size());
+
+  QtRencodeMappedFile::Iterator it = mapped.values();
+  QVERIFY(it.next(&value).ok());
+  QCOMPARE(value, QtRencode::loads(QtRencode::dumps(first)));
+  QVERIFY(it.next(&value).ok());
+  QCOMPARE(value, QtRencode::loads(QtRencode::dumps(second)));
+  QVERIFY(!it.atEnd());
+  qint64 offset = it.offset();
+  QtRencode::Result result = it.next(&value);
+  QCOMPARE(result.error, QtRencode::TruncatedData);
+  QCOMPARE(result.offset, offset + 1);
+  QCOMPARE(it.offset(), offset);
+
+  mapped.close();
+  QVERIFY(!mapped.isOpen());
+  QVERIFY(mapped.values().atEnd());
+}
+
+void TestQtRencode::test_log() {
+  QTemporaryFile file;
+  QVERIFY(file.open());
+  QtRencodeLogWriter writer;
+  QVERIFY(writer.open(file.fileName(), 1000));
+  for (int i = 0; i < 2500; i++)
+    QVERIFY(writer.append(QVariantList() << "rpc" << i).ok());
+  QCOMPARE(writer.count(), qint64(2500));
+  QVERIFY(writer.close());
+
+  QtRencodeLogReader reader;
+  QVERIFY(reader.open(file.fileName()));
+  QVERIFY(reader.isComplete());
+  QCOMPARE(reader.count(), qint64(2500));
+  QVariant value;
+  QVERIFY(reader.read(1234, &value).ok());
+  QCOMPARE(value.toList().at(1).toInt(), 1234);
+  QCOMPARE(reader.record(2499),
+           QtRencode::dumps(QVariant(QVariantList() << "rpc" << 2499)));
+  QVERIFY(!reader.read(2500, &value).ok());
+  reader.close();
+
+  // 写入中断、没有文件尾的日志按帧扫描，丢弃末尾不完整的帧
+  QFile torn(file.fileName());
+  QVERIFY(torn.open(QIODevice::ReadWrite));
+  // 去掉文件尾、最后一个索引帧（500条记录）和最后一条记录的一部分
+  qint64 index = QtRencodeLog::FRAME_HEADER_SIZE + 12 + 500 * 8;
+  QVERIFY(torn.resize(torn.size() - QtRencodeLog::FOOTER_SIZE - index - 3));
+  torn.close();
+  QVERIFY(reader.open(file.fileName()));
+  QVERIFY(!reader.isComplete());
+  QCOMPARE(reader.count(), qint64(2499));
+  QVERIFY(reader.read(2498, &value).ok());
+  QCOMPARE(value.toList().at(1).toInt(), 2498);
+  reader.close();
+
+  // 接着中断的日志追加，最后一个索引帧之后的记录并入新的索引帧
+  QVERIFY(writer.open(file.fileName(), 1000, QtRencodeLogWriter::Append));
+  QCOMPARE(writer.count(), qint64(2499));
+  QVERIFY(writer.append(QVariantList() << "resumed" << 2499).ok());
+  QVERIFY(writer.close());
+  // 再次打开完整的日志追加
+  QVERIFY(writer.open(file.fileName(), 1000, QtRencodeLogWriter::Append));
+  QCOMPARE(writer.count(), qint64(2500));
+  for (int i = 2500; i < 3600; i++)
+    QVERIFY(writer.append(QVariantList() << "rpc" << i).ok());
+  QVERIFY(writer.close());
+  QVERIFY(reader.open(file.fileName()));
+  QVERIFY(reader.isComplete());
+  QCOMPARE(reader.count(), qint64(3600));
+  QVERIFY(reader.read(2498, &value).ok());
+  QCOMPARE(value.toList().at(1).toInt(), 2498);
+  QVERIFY(reader.read(2499, &value).ok());
+  QCOMPARE(value.toList().at(0).toString(), QString("resumed"));
+  QCOMPARE(reader.record(3599),
+           QtRencode::dumps(QVariant(QVariantList() << "rpc" << 3599)));
+  reader.close();
+
+  // 索引帧链指向自身、记录偏移不是记录帧或超出文件时不用索引，改为扫描
+  QList<QByteArray> corrupt;
+  corrupt << indexed_log(14, 0, 0) << indexed_log(0, 1, 14)
+          << indexed_log(0, 1, 1000000);
+  for (const QByteArray &data : corrupt) {
+    QTemporaryFile bad;
+    QVERIFY(bad.open());
+    bad.write(data);
+    bad.flush();
+    QVERIFY(reader.open(bad.fileName()));
+    QVERIFY(!reader.isComplete());
+    QCOMPARE(reader.count(), qint64(1));
+    QCOMPARE(reader.record(0), QtRencode::dumps(QVariant(7)));
+    reader.close();
+  }
+}
+
+void TestQtRencode::test_key_cache() {
+  QVariantMap map;
+  map.insert("id", 1);
+  map.insert(QString(100, 'k'), 2);
+  QVariantList list;
+  for (int i = 0; i < 3; i++) list << map;
+  QByteArray data = QtRencode::dumps(QVariant(list));
+
+  QtRencodeKeyCache cache;
+  QtRencode::Options options;
+  options.keyCache = &cache;
+  QVariant value;
+  QVERIFY(QtRencode::loads(data, &value, options).ok());
+  QCOMPARE(value, QtRencode::loads(data));
+  QCOMPARE(cache.size(), 2);
+  // 重复的键共享同一个QString
+  QVariantList decoded = value.toList();
+  QCOMPARE(decoded.at(0).toMap().firstKey().constData(),
+           decoded.at(2).toMap().firstKey().constData());
+
+  // 命中缓存的键同样受上限约束
+  QtRencode::Limits limits;
+  limits.maxStringLength = 99;
+  QCOMPARE(QtRencode::loads(data, &value, options, limits).error,
+           QtRencode::StringLimitExceeded);
+
+  QtRencodeKeyCache full(true, 1);
+  options.keyCache = &full;
+  QVERIFY(QtRencode::loads(data, &value, options).ok());
+  QCOMPARE(full.size(), 1);
+  full.clear();
+  QCOMPARE(full.size(), 0);
+}
+
 QTEST_APPLESS_MAIN(TestQtRencode)
 
 #include "tst_testqtrencode.moc"